@@ -24,10 +24,19 @@ See the License for the specific language governing permissions and
 #include <iostream>
 #include <memory>
 #include <thread>
+#include <map>
+#include <unordered_map>
+#include <limits>
+#include <atomic>
+#include <functional>
+#include <exception>
 #include "zconf.h"
 #include "Exceptions.h"
 #include "LineGraph.h"
 
+#define MAX_OPEN_QUBITS_PER_GROUP 2 // terms of a pauli sum measured together share one reduced density matrix of this many qubits
+#define MAX_MEMO_TENSOR_VALUES (1LL << 24) // values (tensor values and key entries) the subtree memo table holds before it is emptied
+
 
 
 /*
@@ -53,6 +62,26 @@ namespace qtorch {
         Stochastic, FromEdges, CostContractSimple, CostContractBruteForce
     };
 
+    //one term of a weighted sum of pauli strings - paulis[i] is 'X', 'Y', 'Z' or 'I' on qubit i (missing qubits are 'I')
+    struct PauliTerm {
+        PauliTerm(const std::complex<double> coefficient0, const std::vector<char> &paulis0) : coefficient(coefficient0),
+                                                                                            paulis(paulis0) {};
+
+        std::complex<double> coefficient;
+        std::vector<char> paulis;
+    };
+
+    //the type ContractTensors sums values of type T in - single precision values are summed in double precision
+    template<typename T>
+    struct AccumulatorType {
+        typedef T type;
+    };
+
+    template<>
+    struct AccumulatorType<std::complex<float>> {
+        typedef std::complex<double> type;
+    };
+
     class ContractionTools {
     public:
         explicit ContractionTools(const std::string &inputFile, const std::string &measureFile,
@@ -79,6 +108,69 @@ namespace qtorch {
 
         std::shared_ptr<Network> ContractGivenSequence(const std::vector<std::pair<int, int>> &sequence);
 
+        std::vector<std::complex<double>>
+        ContractObservables(const std::vector<std::vector<char>> &measurements, ContractionType type = Stochastic);
+
+        std::vector<std::complex<double>> ContractObservables(const std::vector<std::vector<char>> &measurements,
+                                                              const std::vector<std::pair<int, int>> &sequence);
+
+        std::vector<std::complex<double>>
+        ReducedDensityMatrix(const std::vector<int> &qubits, ContractionType type = Stochastic);
+
+        std::vector<std::complex<double>> ReducedDensityMatrix(const std::vector<int> &qubits,
+                                                               const std::vector<std::pair<int, int>> &sequence);
+
+        std::vector<std::vector<bool>> SampleBitstrings(const int numSamples, ContractionType type = Stochastic);
+
+        std::vector<std::vector<bool>>
+        SampleBitstrings(const int numSamples, const std::vector<std::pair<int, int>> &sequence);
+
+        std::vector<bool> MostLikelyBitstring(ContractionType type = Stochastic);
+
+        std::vector<bool> MostLikelyBitstring(const std::vector<std::pair<int, int>> &sequence);
+
+        std::complex<double> ExpectationValue(const std::vector<PauliTerm> &terms, ContractionType type = Stochastic);
+
+        std::complex<double>
+        ExpectationValue(const std::vector<PauliTerm> &terms, const std::vector<std::pair<int, int>> &sequence);
+
+        std::vector<std::complex<double>> Gradient(ContractionType type = Stochastic);
+
+        std::vector<std::complex<double>> Gradient(const std::vector<std::pair<int, int>> &sequence);
+
+        std::vector<std::complex<double>>
+        ContractBatch(const std::vector<std::vector<double>> &bindings, ContractionType type = Stochastic);
+
+        std::vector<std::complex<double>> ContractBatch(const std::vector<std::vector<double>> &bindings,
+                                                        const std::vector<std::pair<int, int>> &sequence);
+
+        std::complex<double> ContractIncremental(const std::vector<double> &parameters, ContractionType type = Stochastic);
+
+        std::complex<double>
+        ContractIncremental(const std::vector<double> &parameters, const std::vector<std::pair<int, int>> &sequence);
+
+        std::complex<double> ContractMemoized(ContractionType type = Stochastic);
+
+        std::complex<double> ContractMemoized(const std::vector<std::pair<int, int>> &sequence);
+
+        long long GetNumMemoHits() const noexcept { return mMemoHits; };
+
+        void ClearMemo();
+
+        std::complex<double> ContractWithHyperedges();
+
+        std::complex<double> ContractMixedPrecision(ContractionType type = Stochastic);
+
+        std::complex<double> ContractMixedPrecision(const std::vector<std::pair<int, int>> &sequence);
+
+        double ContractPauliBasis(ContractionType type = Stochastic);
+
+        double ContractPauliBasis(const std::vector<std::pair<int, int>> &sequence);
+
+        int GetHyperedgeWidth() const noexcept { return mHyperedgeWidth; };
+
+        std::vector<std::pair<int, int>> PlanContractionSequence(ContractionType type);
+
         void Reset(const std::string &inputFile, const std::string &measureFile, const int numThreads = 8);
 
         void Reset();
@@ -86,6 +178,7 @@ namespace qtorch {
         void Reset(std::shared_ptr<Network> network) {
             mNetwork = network;
             mCopyCreated = true;
+            ClearIncrementalState();
         };
     private:
         std::string mString;
@@ -96,8 +189,36 @@ namespace qtorch {
         std::shared_ptr<Network> mNetwork;
         std::mt19937 mRandGen;
         bool mCopyCreated;
-        int mNumThreadsInNetwork;
+        int mNumThreadsInNetwork{8}; //also the default when built from a network
+        //kept by ContractIncremental between calls: the network the tensors are read from, the sequence, the wires and
+        //tensor of every node of the sequence, and the angle each parameterized gate was last contracted with
+        std::shared_ptr<Network> mIncrementalNetwork;
+        std::vector<std::pair<int, int>> mIncrementalSequence;
+        std::vector<std::vector<const Wire *>> mIncrementalWires;
+        std::vector<std::vector<std::complex<double>>> mIncrementalTensors;
+        std::vector<double> mIncrementalAngles;
+        //the subtree memo table used by ContractMemoized, kept across contractions and networks: the class of each leaf
+        //tensor (by the hash of its values - the values are shared with the node they came from, and only compared when
+        //two hashes are equal), the class of each contraction of two classes (by the classes and the index positions
+        //joined), and the tensor of each class computed so far. mMemoNumValues counts the values and keys it holds
+        struct MemoLeaf {
+            std::shared_ptr<std::complex<double>> values;
+            long long numValues;
+            int memoClass;
+        };
+        std::unordered_multimap<std::size_t, MemoLeaf> mMemoLeafClasses;
+        std::map<std::vector<int>, int> mMemoStepClasses;
+        std::unordered_map<int, std::shared_ptr<const std::vector<std::complex<double>>>> mMemoTensors;
+        long long mMemoNumValues{0};
+        long long mMemoHits{0};
+        int mMemoNextClass{0};
+        int mHyperedgeWidth{0}; //the largest rank of a tensor made by the last ContractWithHyperedges
     protected:
+        void ClearIncrementalState();
+
+        std::vector<std::vector<bool>>
+        DrawBitstrings(const int numSamples, const std::vector<std::pair<int, int>> &sequence, const bool greedy);
+
         void CreateChunksOfNodes(std::shared_ptr<Network> &myNetwork);
 
         std::shared_ptr<Network> ParallelContract(std::mt19937 &randomGenerator);
@@ -108,6 +229,22 @@ namespace qtorch {
 
         std::shared_ptr<Network> CostBasedContractionBruteForce(const int numSamples);
 
+        std::vector<int> ContractMeasurementIndependentSteps(std::shared_ptr<Network> &network,
+                                                             const std::vector<std::pair<int, int>> &sequence,
+                                                             std::vector<bool> &dependsOnMeasurement);
+
+        static std::vector<std::vector<const Wire *>>
+        SequenceWires(std::shared_ptr<Network> &network, const std::vector<std::pair<int, int>> &sequence);
+
+        template<typename T>
+        static void ContractTensors(const T *valsA, const std::vector<const Wire *> &wiresA,
+                                    const T *valsB, const std::vector<const Wire *> &wiresB,
+                                    const std::vector<const Wire *> &wiresC, T *valsC,
+                                    const int batchSize = 1, const bool batchedA = false, const bool batchedB = false);
+
+        void ContractSequenceStep(std::shared_ptr<Network> &network, const std::vector<std::pair<int, int>> &sequence,
+                                  std::vector<int> &idMap, const int step);
+
         int NumberOfConnectedWires(std::shared_ptr<Node> nodeA, std::shared_ptr<Node> nodeB);
 
         long long CalculateCost(const int pVal, const int indexA, const int indexB, const int thresholdFinalRank,
@@ -122,6 +259,7 @@ namespace qtorch {
     void ContractionTools::Reset() {
         mNetwork = nullptr;
         mCopyCreated = false;
+        ClearIncrementalState();
     }
 
     void ContractionTools::Reset(const std::string &inputFile, const std::string &measureFile, const int numThreads) {
@@ -130,6 +268,15 @@ namespace qtorch {
         mString = inputFile;
         mMeasureFile = measureFile;
         mNumThreadsInNetwork = numThreads;
+        ClearIncrementalState();
+    }
+
+    void ContractionTools::ClearIncrementalState() {
+        mIncrementalNetwork = nullptr;
+        mIncrementalSequence.clear();
+        mIncrementalWires.clear();
+        mIncrementalTensors.clear();
+        mIncrementalAngles.clear();
     }
 
 //this function takes in an enum which is the contraction algorithm you want to run and runs that algorithm
@@ -410,6 +557,1364 @@ namespace qtorch {
         return mNetwork;
     }
 
+/*This function evaluates several observables (one vector of measurement characters per observable, like a measurement file)
+ * on the circuit of this ContractionTools object. The contraction sequence is planned once, by contracting a copy of the
+ * network with the given algorithm, and then used for every observable (see the overload below)
+ */
+    std::vector<std::complex<double>>
+    ContractionTools::ContractObservables(const std::vector<std::vector<char>> &measurements, ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return std::vector<std::complex<double>>();
+        }
+        return ContractObservables(measurements, sequence);
+    }
+
+//this function contracts a copy of the network with the given algorithm and returns the sequence of node id pairs it
+//contracted (as in ContractGivenSequence) - empty if the network could not be opened
+    std::vector<std::pair<int, int>> ContractionTools::PlanContractionSequence(ContractionType type) {
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork;
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return std::vector<std::pair<int, int>>();
+        }
+        int numNodes(myNetwork->GetAllNodes().size());
+        ContractionTools planner(myNetwork->Clone());
+        std::shared_ptr<Network> planned = planner.Contract(type);
+        if (planned == nullptr || !planned->IsDone()) {
+            throw ContractionFailure();
+        }
+        std::vector<std::pair<int, int>> sequence;
+        for (int i(numNodes); i < planned->GetAllNodes().size(); ++i) {
+            sequence.push_back(planned->GetAllNodes()[i]->mCreatedFrom);
+        }
+        return sequence;
+    }
+
+/*This function evaluates several observables on the circuit with one contraction sequence (node id pairs, as in
+ * ContractGivenSequence). Only the measurement nodes differ between observables, so every step of the sequence whose
+ * subtree contains no measurement node is contracted once. Each observable then contracts a clone of that partially
+ * contracted network with its own measurements, doing only the remaining steps.
+ * Returns the value of each observable, in order
+ */
+    std::vector<std::complex<double>> ContractionTools::ContractObservables(
+            const std::vector<std::vector<char>> &measurements, const std::vector<std::pair<int, int>> &sequence) {
+        //the network of this object is left as it is - the shared part of the sequence is contracted on a clone
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return std::vector<std::complex<double>>();
+        }
+
+        int numNodes(myNetwork->GetAllNodes().size());
+        std::vector<bool> dependsOnMeasurement;
+        std::vector<int> idMap(ContractMeasurementIndependentSteps(myNetwork, sequence, dependsOnMeasurement));
+
+        std::vector<std::complex<double>> results;
+        for (const auto &observable: measurements) {
+            std::shared_ptr<Network> network = myNetwork->Clone();
+            for (int i(0); i < network->GetNumQubits(); ++i) {
+                network->SetMeasurement(i, i < observable.size() ? observable[i] : 'T');
+            }
+            std::vector<int> observableIdMap(idMap);
+            for (int i(0); i < sequence.size(); ++i) {
+                if (dependsOnMeasurement[numNodes + i]) {
+                    ContractSequenceStep(network, sequence, observableIdMap, i);
+                }
+            }
+            if (!network->IsDone()) {
+                throw ContractionFailure();
+            }
+            results.push_back(network->GetFinalValue());
+        }
+        return results;
+    }
+
+/*This function returns the reduced density matrix of the given qubits, in the superoperator basis (see
+ * Network::GetReducedDensityMatrix), from a single contraction: the other qubits are traced out and the given qubits are
+ * left open. The sequence is planned on a copy of the closed network with the given algorithm (see the overload below)
+ */
+    std::vector<std::complex<double>>
+    ContractionTools::ReducedDensityMatrix(const std::vector<int> &qubits, ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return std::vector<std::complex<double>>();
+        }
+        return ReducedDensityMatrix(qubits, sequence);
+    }
+
+/*This function returns the reduced density matrix of the given qubits using a sequence planned on the closed network.
+ * The open qubits have no measurement node, so a step that contracts a node with one of them just passes the node on, and
+ * nodes that were only joined through open measurement nodes are joined by an outer product instead
+ */
+    std::vector<std::complex<double>> ContractionTools::ReducedDensityMatrix(
+            const std::vector<int> &qubits, const std::vector<std::pair<int, int>> &sequence) {
+        //the network of this object is left as it is - the contraction is done on a clone
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return std::vector<std::complex<double>>();
+        }
+
+        //the ids of the planned nodes in this network - -1 for nodes made only of open measurement nodes
+        int numNodes(myNetwork->GetAllNodes().size());
+        std::vector<int> idMap(numNodes + sequence.size());
+        std::iota(idMap.begin(), idMap.end(), 0);
+        for (int i(0); i < myNetwork->GetNumQubits(); ++i) {
+            myNetwork->SetMeasurement(i, 'T');
+        }
+        for (int qubit: qubits) {
+            idMap[myNetwork->GetMeasurementNode(qubit)->mID] = -1;
+            myNetwork->OpenQubit(qubit);
+        }
+
+        for (int i(0); i < sequence.size(); ++i) {
+            if (sequence[i].first < 0 || sequence[i].first >= numNodes + i || sequence[i].second < 0 ||
+                sequence[i].second >= numNodes + i) {
+                throw InvalidUserContractionSequence();
+            }
+            ContractSequenceStep(myNetwork, sequence, idMap, i);
+        }
+        return myNetwork->GetReducedDensityMatrix();
+    }
+
+/*This function draws bitstrings from the output distribution of the circuit (in the Z basis), using a contraction sequence
+ * planned on a copy of the network with the given algorithm (see the overload below)
+ */
+    std::vector<std::vector<bool>> ContractionTools::SampleBitstrings(const int numSamples, ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return std::vector<std::vector<bool>>();
+        }
+        return SampleBitstrings(numSamples, sequence);
+    }
+
+//This function draws bitstrings from the output distribution of the circuit (in the Z basis) - see DrawBitstrings
+    std::vector<std::vector<bool>>
+    ContractionTools::SampleBitstrings(const int numSamples, const std::vector<std::pair<int, int>> &sequence) {
+        return DrawBitstrings(numSamples, sequence, false);
+    }
+
+/*This function returns the bitstring built by giving each qubit in turn its more likely value (in the Z basis), given the
+ * bits chosen before it - a tie is broken at random. The contraction sequence is planned on a copy of the network with the
+ * given algorithm (see the overload below)
+ */
+    std::vector<bool> ContractionTools::MostLikelyBitstring(ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return std::vector<bool>();
+        }
+        return MostLikelyBitstring(sequence);
+    }
+
+//This function returns the greedy most likely bitstring (see above), contracted with the given sequence
+    std::vector<bool> ContractionTools::MostLikelyBitstring(const std::vector<std::pair<int, int>> &sequence) {
+        std::vector<std::vector<bool>> bitstrings(DrawBitstrings(1, sequence, true));
+        return bitstrings.empty() ? std::vector<bool>() : bitstrings.front();
+    }
+
+/*This function draws bitstrings qubit by qubit: qubit i is drawn from its marginal given the bits already drawn, which is
+ * the reduced density matrix of qubit i with qubits < i projected on their bits and qubits > i traced out. If greedy is
+ * set, each qubit takes its more likely value instead of a random one, so every bitstring is the greedy most likely one.
+ * A step of the sequence only depends on the measurements in its subtree, so the steps whose measurement nodes all belong
+ * to qubits > i are the same for every sample - they are contracted once, and a clone of the network at that point is
+ * kept for each i. Drawing qubit i then only contracts the steps that touch qubits <= i, and the marginal of each prefix
+ * of bits is cached, so prefixes shared between samples are contracted once
+ */
+    std::vector<std::vector<bool>> ContractionTools::DrawBitstrings(const int numSamples,
+                                                                    const std::vector<std::pair<int, int>> &sequence,
+                                                                    const bool greedy) {
+        //the network of this object is left as it is - the contraction is done on clones
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return std::vector<std::vector<bool>>();
+        }
+
+        //the lowest qubit measured in the subtree of each planned node - numQubits if there is none
+        int numQubits(myNetwork->GetNumQubits());
+        int numNodes(myNetwork->GetAllNodes().size());
+        std::vector<int> lowestQubit(numNodes + sequence.size(), numQubits);
+        for (int i(0); i < numQubits; ++i) {
+            myNetwork->SetMeasurement(i, 'T');
+            lowestQubit[myNetwork->GetMeasurementNode(i)->mID] = i;
+        }
+        for (int i(0); i < sequence.size(); ++i) {
+            if (sequence[i].first < 0 || sequence[i].first >= numNodes + i || sequence[i].second < 0 ||
+                sequence[i].second >= numNodes + i) {
+                throw InvalidUserContractionSequence();
+            }
+            lowestQubit[numNodes + i] = std::min(lowestQubit[sequence[i].first], lowestQubit[sequence[i].second]);
+        }
+
+        //environments[i] has every step that only touches qubits > i contracted, with everything traced out
+        std::vector<std::shared_ptr<Network>> environments(numQubits);
+        std::vector<std::vector<int>> environmentIdMaps(numQubits);
+        std::vector<int> idMap(numNodes + sequence.size());
+        std::iota(idMap.begin(), idMap.end(), 0);
+        for (int qubit(numQubits - 1); qubit >= 0; --qubit) {
+            for (int i(0); i < sequence.size(); ++i) {
+                if (lowestQubit[numNodes + i] == qubit + 1) {
+                    ContractSequenceStep(myNetwork, sequence, idMap, i);
+                }
+            }
+            environments[qubit] = myNetwork->Clone();
+            environmentIdMaps[qubit] = idMap;
+        }
+
+        //the probability that the next qubit is 1, given the bits drawn before it
+        std::map<std::vector<bool>, double> marginals;
+        auto probabilityOfOne = [&](const std::vector<bool> &prefix) {
+            auto found = marginals.find(prefix);
+            if (found != marginals.end()) {
+                return found->second;
+            }
+            int qubit(prefix.size());
+            std::shared_ptr<Network> network = environments[qubit]->Clone();
+            std::vector<int> stepIdMap(environmentIdMaps[qubit]);
+            for (int i(0); i < qubit; ++i) {
+                network->SetMeasurement(i, prefix[i] ? '1' : '0');
+            }
+            stepIdMap[network->GetMeasurementNode(qubit)->mID] = -1;
+            network->OpenQubit(qubit);
+            for (int i(0); i < sequence.size(); ++i) {
+                if (lowestQubit[numNodes + i] <= qubit) {
+                    ContractSequenceStep(network, sequence, stepIdMap, i);
+                }
+            }
+            std::vector<std::complex<double>> rdm(network->GetReducedDensityMatrix());
+            double zero(std::max(rdm[0].real(), 0.0));
+            double one(std::max(rdm[3].real(), 0.0));
+            double probability((zero + one) > 0 ? one / (zero + one) : 0.5);
+            marginals.insert({prefix, probability});
+            return probability;
+        };
+
+        std::uniform_real_distribution<> dist(0.0, 1.0);
+        std::vector<std::vector<bool>> samples;
+        for (int sample(0); sample < numSamples; ++sample) {
+            std::vector<bool> bits;
+            while (bits.size() < numQubits) {
+                double probability(probabilityOfOne(bits));
+                if (greedy && probability != 0.5) {
+                    bits.push_back(probability > 0.5);
+                } else {
+                    bits.push_back(dist(mRandGen) < probability);
+                }
+            }
+            samples.push_back(bits);
+        }
+        return samples;
+    }
+
+/*This function returns the expectation value of a weighted sum of pauli strings (e.g. a hamiltonian) on the circuit, using
+ * a contraction sequence planned on a copy of the network with the given algorithm (see the overload below)
+ */
+    std::complex<double> ContractionTools::ExpectationValue(const std::vector<PauliTerm> &terms, ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return std::complex<double>(0.0);
+        }
+        return ExpectationValue(terms, sequence);
+    }
+
+/*This function returns the expectation value of a weighted sum of pauli strings with one contraction sequence.
+ * The steps that do not depend on a measurement are contracted once for all terms. Terms that measure each shared qubit in
+ * the same basis and whose light cones (the steps that depend on their measurements) overlap are grouped while their
+ * qubits fit in MAX_OPEN_QUBITS_PER_GROUP, each term joining the group its light cone overlaps most. A group is evaluated
+ * from one contraction: the reduced density matrix of its qubits (see ReducedDensityMatrix). Every open qubit multiplies the size
+ * of the nodes it passes through by 4, so longer terms, and terms left alone in a group, are contracted on their own.
+ * The groups and single terms are contracted in parallel, on up to the number of threads given to this object
+ */
+    std::complex<double> ContractionTools::ExpectationValue(const std::vector<PauliTerm> &terms,
+                                                            const std::vector<std::pair<int, int>> &sequence) {
+        //the network of this object is left as it is - the shared part of the sequence is contracted on a clone
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return std::complex<double>(0.0);
+        }
+        int numQubits(myNetwork->GetNumQubits());
+        int numNodes(myNetwork->GetAllNodes().size());
+
+        //the measurement of each term on every qubit - identities are traced out
+        std::vector<std::vector<char>> measurements;
+        for (const auto &term: terms) {
+            if (term.paulis.size() > numQubits) {
+                throw InvalidFunctionInput();
+            }
+            std::vector<char> measurement(numQubits, 'T');
+            for (int i(0); i < term.paulis.size(); ++i) {
+                if (term.paulis[i] == 'X' || term.paulis[i] == 'Y' || term.paulis[i] == 'Z') {
+                    measurement[i] = term.paulis[i];
+                } else if (term.paulis[i] != 'I' && term.paulis[i] != 'T') {
+                    throw InvalidFunctionInput();
+                }
+            }
+            measurements.push_back(measurement);
+        }
+
+        std::vector<bool> dependsOnMeasurement;
+        std::vector<int> idMap(ContractMeasurementIndependentSteps(myNetwork, sequence, dependsOnMeasurement));
+
+        //the light cone of each qubit: the nodes of the sequence whose subtree holds its measurement node
+        std::vector<std::vector<bool>> qubitCones(numQubits, std::vector<bool>(numNodes + sequence.size(), false));
+        for (int i(0); i < numQubits; ++i) {
+            qubitCones[i][myNetwork->GetMeasurementNode(i)->mID] = true;
+            for (int step(0); step < sequence.size(); ++step) {
+                qubitCones[i][numNodes + step] = qubitCones[i][sequence[step].first] || qubitCones[i][sequence[step].second];
+            }
+        }
+
+        //put each short term in the compatible group its light cone overlaps most
+        std::vector<std::vector<char>> groupBases;
+        std::vector<std::vector<bool>> groupCones;
+        std::vector<std::vector<int>> groupTerms;
+        std::vector<int> singleTerms;
+        for (int term(0); term < terms.size(); ++term) {
+            int support(numQubits - std::count(measurements[term].begin(), measurements[term].end(), 'T'));
+            if (support > MAX_OPEN_QUBITS_PER_GROUP) {
+                singleTerms.push_back(term);
+                continue;
+            }
+            std::vector<bool> cone(numNodes + sequence.size(), false);
+            for (int i(0); i < numQubits; ++i) {
+                if (measurements[term][i] != 'T') {
+                    std::transform(cone.begin(), cone.end(), qubitCones[i].begin(), cone.begin(), std::logical_or<bool>());
+                }
+            }
+            int bestGroup(-1);
+            long long bestOverlap(0);
+            for (int group(0); group < groupBases.size(); ++group) {
+                int shared(0);
+                int groupSupport(numQubits - std::count(groupBases[group].begin(), groupBases[group].end(), 'T'));
+                bool compatible(true);
+                for (int i(0); i < numQubits && compatible; ++i) {
+                    if (measurements[term][i] != 'T' && groupBases[group][i] != 'T') {
+                        compatible = measurements[term][i] == groupBases[group][i];
+                        ++shared;
+                    }
+                }
+                if (!compatible || groupSupport + support - shared > MAX_OPEN_QUBITS_PER_GROUP) {
+                    continue;
+                }
+                long long overlap(0);
+                for (long long j(numNodes); j < cone.size(); ++j) {
+                    overlap += cone[j] && groupCones[group][j];
+                }
+                if (overlap > bestOverlap) {
+                    bestGroup = group;
+                    bestOverlap = overlap;
+                }
+            }
+            if (bestGroup < 0) {
+                groupBases.push_back(measurements[term]);
+                groupCones.push_back(cone);
+                groupTerms.push_back({term});
+                continue;
+            }
+            for (int i(0); i < numQubits; ++i) {
+                if (measurements[term][i] != 'T') {
+                    groupBases[bestGroup][i] = measurements[term][i];
+                }
+            }
+            std::transform(cone.begin(), cone.end(), groupCones[bestGroup].begin(), groupCones[bestGroup].begin(),
+                           std::logical_or<bool>());
+            groupTerms[bestGroup].push_back(term);
+        }
+        //a term alone in its group is cheaper to contract closed
+        for (int group(groupTerms.size() - 1); group >= 0; --group) {
+            if (groupTerms[group].size() == 1) {
+                singleTerms.push_back(groupTerms[group].front());
+                groupTerms.erase(groupTerms.begin() + group);
+                groupBases.erase(groupBases.begin() + group);
+            }
+        }
+
+        //this lambda contracts the steps that depend on the measurements, on a clone of the shared network
+        auto contractDependentSteps = [&](std::shared_ptr<Network> &network, std::vector<int> &unitIdMap) {
+            for (int i(0); i < sequence.size(); ++i) {
+                if (dependsOnMeasurement[numNodes + i]) {
+                    ContractSequenceStep(network, sequence, unitIdMap, i);
+                }
+            }
+        };
+
+        //this lambda evaluates one group (unit < number of groups) or one single term, storing the values of its terms
+        std::vector<std::complex<double>> values(terms.size());
+        auto evaluateUnit = [&](const int unit) {
+            std::shared_ptr<Network> network = myNetwork->Clone();
+            std::vector<int> unitIdMap(idMap);
+            if (unit >= groupBases.size()) {
+                int term(singleTerms[unit - groupBases.size()]);
+                for (int i(0); i < numQubits; ++i) {
+                    network->SetMeasurement(i, measurements[term][i]);
+                }
+                contractDependentSteps(network, unitIdMap);
+                if (!network->IsDone()) {
+                    throw ContractionFailure();
+                }
+                values[term] = network->GetFinalValue();
+                return;
+            }
+
+            std::vector<int> openQubits;
+            for (int i(0); i < numQubits; ++i) {
+                network->SetMeasurement(i, 'T');
+                if (groupBases[unit][i] != 'T') {
+                    openQubits.push_back(i);
+                    unitIdMap[network->GetMeasurementNode(i)->mID] = -1;
+                    network->OpenQubit(i);
+                }
+            }
+            contractDependentSteps(network, unitIdMap);
+            std::vector<std::complex<double>> rdm(network->GetReducedDensityMatrix());
+            for (int term: groupTerms[unit]) {
+                //the measurement operator of the term on each open qubit
+                std::vector<std::shared_ptr<Node>> operators;
+                for (int qubit: openQubits) {
+                    operators.push_back(Network::CreateMeasurementNode(measurements[term][qubit]));
+                }
+                std::complex<double> value(0.0);
+                for (long long j(0); j < rdm.size(); ++j) {
+                    std::complex<double> weight(1.0);
+                    for (int k(0); k < operators.size(); ++k) {
+                        weight *= operators[k]->GetTensorData()[(j >> (2 * k)) % 4];
+                    }
+                    value += weight * rdm[j];
+                }
+                values[term] = value;
+            }
+        };
+
+        //contract the units on a few threads, each taking the next unit that is left
+        int numUnits(groupBases.size() + singleTerms.size());
+        std::atomic<int> nextUnit(0);
+        std::exception_ptr failure;
+        std::mutex failureLock;
+        auto worker = [&]() {
+            for (int unit(nextUnit++); unit < numUnits; unit = nextUnit++) {
+                try {
+                    evaluateUnit(unit);
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(failureLock);
+                    failure = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int i(1); i < std::min(mNumThreadsInNetwork, numUnits); ++i) {
+            threads.push_back(std::thread(worker));
+        }
+        worker();
+        for (auto &t: threads) {
+            t.join();
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+
+        std::complex<double> expectation(0.0);
+        for (int term(0); term < terms.size(); ++term) {
+            expectation += terms[term].coefficient * values[term];
+        }
+        return expectation;
+    }
+
+/*This function returns the derivative of the expectation value of the network with respect to each of its parameters (see
+ * Network::BindParameters), using a contraction sequence planned on a copy of the network with the given algorithm
+ */
+    std::vector<std::complex<double>> ContractionTools::Gradient(ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return std::vector<std::complex<double>>();
+        }
+        return Gradient(sequence);
+    }
+
+/*This function returns the derivative of the expectation value with respect to each parameter, by reverse-mode
+ * differentiation through the contraction sequence. The forward pass contracts the sequence keeping every intermediate
+ * tensor, and sets the final value (see GetFinalVal). The backward pass then gives each node the contraction of everything
+ * else in the network (its environment): the environment of the two nodes of a step is the environment of the result
+ * contracted with the other node. The derivative for a parameterized gate is its environment contracted with the
+ * derivative of its tensor. Every entry of a rotation or phase gate tensor is a + b cos(angle) + c sin(angle), so that
+ * derivative is exactly (T(angle + pi/2) - T(angle - pi/2)) / 2
+ */
+    std::vector<std::complex<double>> ContractionTools::Gradient(const std::vector<std::pair<int, int>> &sequence) {
+        //the network of this object is left as it is - the tensors are read from a clone
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return std::vector<std::complex<double>>();
+        }
+        int numNodes(myNetwork->GetAllNodes().size());
+        std::vector<std::vector<const Wire *>> wires(SequenceWires(myNetwork, sequence));
+
+        //forward pass - node i of the plan is created by step i - numNodes
+        std::vector<std::vector<std::complex<double>>> tensors(numNodes + sequence.size());
+        for (int i(0); i < numNodes; ++i) {
+            if (!myNetwork->GetAllNodes()[i]->mContracted) {
+                tensors[i] = myNetwork->GetAllNodes()[i]->GetTensorVals();
+            }
+        }
+        for (int i(0); i < sequence.size(); ++i) {
+            int a(sequence[i].first);
+            int b(sequence[i].second);
+            tensors[numNodes + i].resize(1LL << (2 * wires[numNodes + i].size()));
+            ContractTensors(tensors[a].data(), wires[a], tensors[b].data(), wires[b], wires[numNodes + i],
+                            tensors[numNodes + i].data());
+        }
+        int root(numNodes + sequence.size() - 1);
+        mFinalVal = tensors[root][0];
+
+        //backward pass - each node is used by exactly one step, so its environment is set once
+        std::vector<std::vector<std::complex<double>>> environments(numNodes + sequence.size());
+        environments[root] = {1.0};
+        for (int i(sequence.size() - 1); i >= 0; --i) {
+            int a(sequence[i].first);
+            int b(sequence[i].second);
+            environments[a].resize(tensors[a].size());
+            ContractTensors(environments[numNodes + i].data(), wires[numNodes + i], tensors[b].data(), wires[b],
+                            wires[a], environments[a].data());
+            environments[b].resize(tensors[b].size());
+            ContractTensors(environments[numNodes + i].data(), wires[numNodes + i], tensors[a].data(), wires[a],
+                            wires[b], environments[b].data());
+            //the intermediate tensor is no longer needed
+            std::vector<std::complex<double>>().swap(tensors[numNodes + i]);
+            std::vector<std::complex<double>>().swap(environments[numNodes + i]);
+        }
+
+        std::vector<std::complex<double>> gradient(myNetwork->GetNumParameters());
+        //the angles come from the bound parameters, which a snapshot keeps (its nodes only keep their tensors)
+        const std::vector<double> &parameters = myNetwork->GetParameters();
+        for (int i(0); i < numNodes; ++i) {
+            const std::shared_ptr<Node> &node = myNetwork->GetAllNodes()[i];
+            if (node->mParameterSlot < 0 || environments[i].empty()) {
+                continue;
+            }
+            double angle(node->mParameterSlot < parameters.size()
+                         ? node->mParameterScale * parameters[node->mParameterSlot] : 0.0);
+            Node shiftedUp(*node);
+            shiftedUp.SetAngle(angle + PI / 2);
+            Node shiftedDown(*node);
+            shiftedDown.SetAngle(angle - PI / 2);
+            const std::complex<double> *up = shiftedUp.GetTensorData();
+            const std::complex<double> *down = shiftedDown.GetTensorData();
+            std::complex<double> derivative(0.0);
+            for (long long j(0); j < environments[i].size(); ++j) {
+                derivative += environments[i][j] * (up[j] - down[j]) * 0.5;
+            }
+            gradient[node->mParameterSlot] += node->mParameterScale * derivative;
+        }
+        return gradient;
+    }
+
+/*This function returns the expectation value of the network for each set of parameter values (see
+ * Network::BindParameters), using a contraction sequence planned on a copy of the network with the given algorithm
+ */
+    std::vector<std::complex<double>>
+    ContractionTools::ContractBatch(const std::vector<std::vector<double>> &bindings, ContractionType type) {
+        if (bindings.empty()) {
+            return std::vector<std::complex<double>>();
+        }
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return std::vector<std::complex<double>>();
+        }
+        return ContractBatch(bindings, sequence);
+    }
+
+/*This function returns the expectation value of the network for each set of parameter values, in one pass over the
+ * contraction sequence. Each parameterized gate gets a stack of tensors, one for each set of values, and every node the
+ * stack reaches carries it through its contractions - the rest of the network is contracted once for the whole batch
+ */
+    std::vector<std::complex<double>> ContractionTools::ContractBatch(const std::vector<std::vector<double>> &bindings,
+                                                                      const std::vector<std::pair<int, int>> &sequence) {
+        //the network of this object is left as it is - the tensors are read from a clone
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return std::vector<std::complex<double>>();
+        }
+        for (const auto &binding: bindings) {
+            if (binding.size() < myNetwork->GetNumParameters()) {
+                throw InvalidFunctionInput();
+            }
+        }
+        if (bindings.empty()) {
+            return std::vector<std::complex<double>>();
+        }
+        int numNodes(myNetwork->GetAllNodes().size());
+        int batchSize(bindings.size());
+        std::vector<std::vector<const Wire *>> wires(SequenceWires(myNetwork, sequence));
+
+        std::vector<std::vector<std::complex<double>>> tensors(numNodes + sequence.size());
+        std::vector<bool> batched(numNodes + sequence.size(), false);
+        for (int i(0); i < numNodes; ++i) {
+            const std::shared_ptr<Node> &node = myNetwork->GetAllNodes()[i];
+            if (node->mContracted) {
+                continue;
+            }
+            if (node->mParameterSlot < 0) {
+                tensors[i] = node->GetTensorVals();
+                continue;
+            }
+            batched[i] = true;
+            for (const auto &binding: bindings) {
+                Node bound(*node);
+                bound.SetAngle(node->mParameterScale * binding[node->mParameterSlot]);
+                const std::complex<double> *vals = bound.GetTensorData();
+                tensors[i].insert(tensors[i].end(), vals, vals + bound.GetNumTensorVals());
+            }
+        }
+        for (int i(0); i < sequence.size(); ++i) {
+            int a(sequence[i].first);
+            int b(sequence[i].second);
+            batched[numNodes + i] = batched[a] || batched[b];
+            tensors[numNodes + i].resize((batched[numNodes + i] ? batchSize : 1) * (1LL << (2 * wires[numNodes + i].size())));
+            ContractTensors(tensors[a].data(), wires[a], tensors[b].data(), wires[b], wires[numNodes + i],
+                            tensors[numNodes + i].data(), batched[numNodes + i] ? batchSize : 1, batched[a], batched[b]);
+            //each node is used by one step only
+            std::vector<std::complex<double>>().swap(tensors[a]);
+            std::vector<std::complex<double>>().swap(tensors[b]);
+        }
+        const std::vector<std::complex<double>> &root(tensors.back());
+        std::vector<std::complex<double>> values(batchSize, root[0]);
+        if (batched.back()) {
+            values.assign(root.begin(), root.end());
+        }
+        return values;
+    }
+
+/*This function contracts the network with the given parameter values (see Network::BindParameters), like
+ * ContractIncremental with a sequence, planning the sequence with the given algorithm on the first call only
+ */
+    std::complex<double>
+    ContractionTools::ContractIncremental(const std::vector<double> &parameters, ContractionType type) {
+        if (mIncrementalSequence.empty()) {
+            std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+            if (sequence.empty()) {
+                return mFinalVal;
+            }
+            return ContractIncremental(parameters, sequence);
+        }
+        return ContractIncremental(parameters, mIncrementalSequence);
+    }
+
+/*This function contracts the network with the given parameter values and returns the value (also set as the final value).
+ * The tensor of every node of the sequence is kept between calls with the same sequence, and only the nodes built from a
+ * gate whose angle changed are contracted again - when one parameter changes, that is the path from its gates to the root
+ */
+    std::complex<double> ContractionTools::ContractIncremental(const std::vector<double> &parameters,
+                                                               const std::vector<std::pair<int, int>> &sequence) {
+        if (!mIncrementalNetwork || sequence != mIncrementalSequence) {
+            ClearIncrementalState();
+            //the network of this object is left as it is - the tensors are read from a clone
+            if (!mCopyCreated) {
+                mIncrementalNetwork = std::make_shared<Network>(mString, mMeasureFile);
+                mIncrementalNetwork->SetNumThreads(mNumThreadsInNetwork);
+            } else {
+                mIncrementalNetwork = mNetwork->Clone();
+            }
+            if (mIncrementalNetwork->HasFailed()) //if you fail to open the network
+            {
+                mIncrementalNetwork = nullptr;
+                return mFinalVal;
+            }
+            mIncrementalWires = SequenceWires(mIncrementalNetwork, sequence);
+            mIncrementalSequence = sequence;
+            mIncrementalTensors.resize(mIncrementalWires.size());
+            mIncrementalAngles.assign(mIncrementalNetwork->GetAllNodes().size(), 0.0);
+        }
+        if (parameters.size() < mIncrementalNetwork->GetNumParameters()) {
+            throw InvalidFunctionInput();
+        }
+        int numNodes(mIncrementalNetwork->GetAllNodes().size());
+
+        //load the tensors that are missing or whose angle changed
+        std::vector<bool> changed(mIncrementalTensors.size(), false);
+        for (int i(0); i < numNodes; ++i) {
+            const std::shared_ptr<Node> &node = mIncrementalNetwork->GetAllNodes()[i];
+            if (node->mContracted) {
+                continue;
+            }
+            if (node->mParameterSlot < 0) {
+                if (mIncrementalTensors[i].empty()) {
+                    mIncrementalTensors[i] = node->GetTensorVals();
+                    changed[i] = true;
+                }
+                continue;
+            }
+            double angle(node->mParameterScale * parameters[node->mParameterSlot]);
+            if (mIncrementalTensors[i].empty() || angle != mIncrementalAngles[i]) {
+                Node bound(*node);
+                bound.SetAngle(angle);
+                mIncrementalTensors[i] = bound.GetTensorVals();
+                mIncrementalAngles[i] = angle;
+                changed[i] = true;
+            }
+        }
+
+        for (int i(0); i < sequence.size(); ++i) {
+            int a(sequence[i].first);
+            int b(sequence[i].second);
+            if (!changed[a] && !changed[b]) {
+                continue;
+            }
+            changed[numNodes + i] = true;
+            mIncrementalTensors[numNodes + i].resize(1LL << (2 * mIncrementalWires[numNodes + i].size()));
+            ContractTensors(mIncrementalTensors[a].data(), mIncrementalWires[a], mIncrementalTensors[b].data(),
+                            mIncrementalWires[b], mIncrementalWires[numNodes + i],
+                            mIncrementalTensors[numNodes + i].data());
+        }
+        mFinalVal = mIncrementalTensors.back()[0];
+        return mFinalVal;
+    }
+
+/*This function contracts the network like ContractMemoized with a sequence, planning the sequence on a copy of the network
+ * with the given algorithm
+ */
+    std::complex<double> ContractionTools::ContractMemoized(ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return mFinalVal;
+        }
+        return ContractMemoized(sequence);
+    }
+
+/*This function contracts the network along the sequence and returns the value (also set as the final value), looking up
+ * every intermediate tensor in the subtree memo table first. Two subtrees get the same class when their leaves have the
+ * same values and are joined in the same pattern, so a repeated subnetwork (within this contraction, or in an earlier one
+ * of any network) is contracted once. The table is emptied when its tensors and keys would grow past
+ * MAX_MEMO_TENSOR_VALUES
+ */
+    std::complex<double> ContractionTools::ContractMemoized(const std::vector<std::pair<int, int>> &sequence) {
+        //the network of this object is left as it is - the tensors are read from a clone
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return mFinalVal;
+        }
+        int numNodes(myNetwork->GetAllNodes().size());
+        std::vector<std::vector<const Wire *>> wires(SequenceWires(myNetwork, sequence));
+
+        //makes room for numValues more values in the table, emptying it if they don't fit - returns false if they never will
+        auto makeRoom = [this](long long numValues) {
+            if (mMemoNumValues + numValues > MAX_MEMO_TENSOR_VALUES) {
+                ClearMemo();
+            }
+            return numValues <= MAX_MEMO_TENSOR_VALUES;
+        };
+
+        //the values of each node of the sequence - the leaves are read in place, the intermediates are kept in tensors
+        std::vector<const std::complex<double> *> values(wires.size(), nullptr);
+        std::vector<std::shared_ptr<const std::vector<std::complex<double>>>> tensors(wires.size());
+        std::vector<int> classes(wires.size(), -1);
+        std::hash<double> hashDouble;
+        for (int i(0); i < numNodes; ++i) {
+            const std::shared_ptr<Node> &node = myNetwork->GetAllNodes()[i];
+            if (node->mContracted) {
+                continue;
+            }
+            values[i] = node->GetTensorData();
+            long long numValues(node->GetNumTensorVals());
+            std::size_t hash(static_cast<std::size_t>(numValues));
+            for (long long j(0); j < numValues; ++j) {
+                for (double part: {values[i][j].real(), values[i][j].imag()}) {
+                    hash ^= hashDouble(part) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+                }
+            }
+            auto candidates = mMemoLeafClasses.equal_range(hash);
+            auto found = std::find_if(candidates.first, candidates.second,
+                                      [&](const std::pair<const std::size_t, MemoLeaf> &leaf) {
+                                          return leaf.second.numValues == numValues &&
+                                                 std::equal(values[i], values[i] + numValues, leaf.second.values.get());
+                                      });
+            if (found != candidates.second) {
+                classes[i] = found->second.memoClass;
+                continue;
+            }
+            classes[i] = mMemoNextClass++;
+            if (makeRoom(numValues)) {
+                mMemoLeafClasses.insert({hash, MemoLeaf{node->GetSharedTensorVals(), numValues, classes[i]}});
+                mMemoNumValues += numValues;
+            }
+        }
+
+        for (int i(0); i < sequence.size(); ++i) {
+            int a(sequence[i].first);
+            int b(sequence[i].second);
+            //the result only depends on the two tensors and which of their indices are joined
+            std::vector<int> key{classes[a], classes[b]};
+            for (int j(0); j < wires[a].size(); ++j) {
+                auto shared = std::find(wires[b].begin(), wires[b].end(), wires[a][j]);
+                if (shared != wires[b].end()) {
+                    key.push_back(j);
+                    key.push_back(shared - wires[b].begin());
+                }
+            }
+            auto found = mMemoStepClasses.find(key);
+            if (found != mMemoStepClasses.end()) {
+                classes[numNodes + i] = found->second;
+            } else {
+                classes[numNodes + i] = mMemoNextClass++;
+                if (makeRoom(key.size())) {
+                    mMemoStepClasses.insert({key, classes[numNodes + i]});
+                    mMemoNumValues += key.size();
+                }
+            }
+
+            auto memoized = mMemoTensors.find(classes[numNodes + i]);
+            if (memoized != mMemoTensors.end()) {
+                tensors[numNodes + i] = memoized->second;
+                ++mMemoHits;
+            } else {
+                std::shared_ptr<std::vector<std::complex<double>>> result = std::make_shared<std::vector<std::complex<double>>>(
+                        1LL << (2 * wires[numNodes + i].size()));
+                ContractTensors(values[a], wires[a], values[b], wires[b], wires[numNodes + i], result->data());
+                if (makeRoom(result->size())) {
+                    mMemoTensors[classes[numNodes + i]] = result;
+                    mMemoNumValues += result->size();
+                }
+                tensors[numNodes + i] = result;
+            }
+            values[numNodes + i] = tensors[numNodes + i]->data();
+            tensors[a] = nullptr;
+            tensors[b] = nullptr;
+        }
+        mFinalVal = (*tensors.back())[0];
+        return mFinalVal;
+    }
+
+//this function empties the subtree memo table
+    void ContractionTools::ClearMemo() {
+        mMemoLeafClasses.clear();
+        mMemoStepClasses.clear();
+        mMemoTensors.clear();
+        mMemoNumValues = 0;
+    }
+
+/*This function contracts the network with the wires of each chain of diagonal gates (Rz, Phase, Z, CZ, CPhase, CRk, RZZ)
+ * merged into one hyperedge, and returns the value (also set as the final value). A diagonal gate does not change the
+ * index of a qubit, so its input and output wire carry the same index: the gate becomes a tensor of rank 1 or 2 holding its
+ * diagonal, and every tensor on the chain shares that index. The tensors are contracted greedily, always the pair sharing
+ * an index that makes the smallest tensor - a shared index is only summed over once no other tensor holds it, until then
+ * the two tensors are multiplied elementwise on it. Throws if the network has open wires
+ */
+    std::complex<double> ContractionTools::ContractWithHyperedges() {
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork;
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return mFinalVal;
+        }
+
+        //union-find over the wires: the input and output wire of each qubit of a diagonal gate are one hyperedge
+        std::unordered_map<const Wire *, const Wire *> parent;
+        auto root = [&parent](const Wire *tempWire) {
+            for (auto found = parent.find(tempWire); found != parent.end(); found = parent.find(tempWire)) {
+                tempWire = found->second;
+            }
+            return tempWire;
+        };
+        std::vector<std::shared_ptr<Node>> nodes;
+        for (const auto &node: myNetwork->GetAllNodes()) {
+            if (node->mContracted) {
+                continue;
+            }
+            nodes.push_back(node);
+            for (const auto &tempWire: node->GetWires()) {
+                if (tempWire->GetNodeA().expired() || tempWire->GetNodeB().expired()) {
+                    throw ContractionFailure();
+                }
+            }
+            if (node->mDiagonal) {
+                int numQubits(node->mRank / 2);
+                for (int i(0); i < numQubits; ++i) {
+                    const Wire *in = root(node->GetWires()[i].get());
+                    const Wire *out = root(node->GetWires()[i + numQubits].get());
+                    if (in != out) {
+                        parent[out] = in;
+                    }
+                }
+            }
+        }
+
+        //the labels and values of every tensor - a diagonal gate keeps the entries where input and output indices agree
+        std::vector<std::vector<const Wire *>> labels;
+        std::vector<std::vector<std::complex<double>>> tensors;
+        std::unordered_map<const Wire *, std::vector<int>> holders; //the live tensors with each label
+        for (const auto &node: nodes) {
+            std::vector<std::complex<double>> vals(node->GetTensorVals());
+            std::vector<const Wire *> tensorLabels;
+            int numIndices(node->mDiagonal ? node->mRank / 2 : node->mRank);
+            for (int i(0); i < numIndices; ++i) {
+                tensorLabels.push_back(root(node->GetWires()[i].get()));
+            }
+            if (node->mDiagonal) {
+                std::vector<std::complex<double>> diagonal(1LL << (2 * numIndices));
+                for (long long d(0); d < diagonal.size(); ++d) {
+                    //digit i of d goes on input index i and output index i + numIndices
+                    long long index(0);
+                    for (int i(0); i < numIndices; ++i) {
+                        long long digit((d >> (2 * i)) & 3);
+                        index += digit << (2 * i);
+                        index += digit << (2 * (i + numIndices));
+                    }
+                    diagonal[d] = vals[index];
+                }
+                vals.swap(diagonal);
+            }
+            for (const Wire *label: tensorLabels) {
+                holders[label].push_back(labels.size());
+            }
+            labels.push_back(tensorLabels);
+            tensors.push_back(std::move(vals));
+        }
+
+        //the labels of the tensor made by contracting two live tensors - a label stays while another tensor holds it
+        auto resultLabels = [&labels, &holders](int a, int b) {
+            std::vector<const Wire *> result;
+            for (const Wire *label: labels[a]) {
+                bool inB(std::find(labels[b].begin(), labels[b].end(), label) != labels[b].end());
+                if (holders.at(label).size() > (inB ? 2 : 1)) {
+                    result.push_back(label);
+                }
+            }
+            for (const Wire *label: labels[b]) {
+                if (std::find(labels[a].begin(), labels[a].end(), label) == labels[a].end() &&
+                    holders.at(label).size() > 1) {
+                    result.push_back(label);
+                }
+            }
+            return result;
+        };
+
+        std::vector<bool> live(tensors.size(), true);
+        mHyperedgeWidth = 0;
+        for (int numLive(tensors.size()); numLive > 1; --numLive) {
+            //the pair sharing a label with the smallest result, else (disconnected parts) the two smallest tensors
+            int bestA(-1), bestB(-1);
+            int bestRank(std::numeric_limits<int>::max());
+            for (const auto &holder: holders) {
+                for (int i(0); i < holder.second.size(); ++i) {
+                    for (int j(i + 1); j < holder.second.size(); ++j) {
+                        int rank(resultLabels(holder.second[i], holder.second[j]).size());
+                        if (rank < bestRank) {
+                            bestRank = rank;
+                            bestA = holder.second[i];
+                            bestB = holder.second[j];
+                        }
+                    }
+                }
+            }
+            if (bestA == -1) {
+                for (int i(0); i < tensors.size(); ++i) {
+                    if (!live[i]) {
+                        continue;
+                    }
+                    if (bestA == -1 || labels[i].size() < labels[bestA].size()) {
+                        bestB = bestA;
+                        bestA = i;
+                    } else if (bestB == -1 || labels[i].size() < labels[bestB].size()) {
+                        bestB = i;
+                    }
+                }
+            }
+
+            std::vector<const Wire *> newLabels(resultLabels(bestA, bestB));
+            std::vector<std::complex<double>> newVals(1LL << (2 * newLabels.size()));
+            ContractTensors(tensors[bestA].data(), labels[bestA], tensors[bestB].data(), labels[bestB], newLabels,
+                            newVals.data());
+            mHyperedgeWidth = std::max(mHyperedgeWidth, static_cast<int>(newLabels.size()));
+
+            //the new tensor takes the place of bestA
+            for (int removed: {bestA, bestB}) {
+                for (const Wire *label: labels[removed]) {
+                    std::vector<int> &labelHolders = holders[label];
+                    labelHolders.erase(std::find(labelHolders.begin(), labelHolders.end(), removed));
+                    if (labelHolders.empty()) {
+                        holders.erase(label);
+                    }
+                }
+            }
+            for (const Wire *label: newLabels) {
+                holders[label].push_back(bestA);
+            }
+            labels[bestA].swap(newLabels);
+            tensors[bestA].swap(newVals);
+            labels[bestB].clear();
+            tensors[bestB].clear();
+            live[bestB] = false;
+        }
+        for (int i(0); i < tensors.size(); ++i) {
+            if (live[i]) {
+                mFinalVal = tensors[i][0];
+            }
+        }
+        return mFinalVal;
+    }
+
+/*This function contracts the network like ContractMixedPrecision with a sequence, planning the sequence on a copy of the
+ * network with the given algorithm
+ */
+    std::complex<double> ContractionTools::ContractMixedPrecision(ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return mFinalVal;
+        }
+        return ContractMixedPrecision(sequence);
+    }
+
+/*This function contracts the network along the sequence and returns the value (also set as the final value), storing every
+ * tensor in single precision (std::complex<float>, half the memory of the nodes). Each value of a step is accumulated in
+ * double precision and rounded once when it is stored, so the error grows with the number of steps, not with their size
+ */
+    std::complex<double> ContractionTools::ContractMixedPrecision(const std::vector<std::pair<int, int>> &sequence) {
+        //the network of this object is left as it is - the tensors are read from a clone
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return mFinalVal;
+        }
+        int numNodes(myNetwork->GetAllNodes().size());
+        std::vector<std::vector<const Wire *>> wires(SequenceWires(myNetwork, sequence));
+
+        std::vector<std::vector<std::complex<float>>> tensors(wires.size());
+        for (int i(0); i < numNodes; ++i) {
+            const std::shared_ptr<Node> &node = myNetwork->GetAllNodes()[i];
+            if (node->mContracted) {
+                continue;
+            }
+            const std::complex<double> *vals = node->GetTensorData();
+            tensors[i].assign(vals, vals + node->GetNumTensorVals());
+        }
+        for (int i(0); i < sequence.size(); ++i) {
+            int a(sequence[i].first);
+            int b(sequence[i].second);
+            tensors[numNodes + i].resize(1LL << (2 * wires[numNodes + i].size()));
+            ContractTensors(tensors[a].data(), wires[a], tensors[b].data(), wires[b], wires[numNodes + i],
+                            tensors[numNodes + i].data());
+            std::vector<std::complex<float>>().swap(tensors[a]);
+            std::vector<std::complex<float>>().swap(tensors[b]);
+        }
+        mFinalVal = std::complex<double>(tensors.back()[0]);
+        return mFinalVal;
+    }
+
+/*This function contracts the network like ContractPauliBasis with a sequence, planning the sequence on a copy of the
+ * network with the given algorithm
+ */
+    double ContractionTools::ContractPauliBasis(ContractionType type) {
+        std::vector<std::pair<int, int>> sequence(PlanContractionSequence(type));
+        if (sequence.empty()) {
+            return mFinalVal.real();
+        }
+        return ContractPauliBasis(sequence);
+    }
+
+/*This function contracts the network along the sequence in the Pauli basis and returns the value (also set as the final
+ * value). Every wire carries the Pauli coefficients Tr(P rho) of the state instead of the entries |i><j| of rho, so every
+ * tensor - the states, the measurements and the Pauli transfer matrix of every gate - is real, and the contraction is done
+ * in real arithmetic. The value is the same, since the change of basis on the two ends of a wire cancels. Throws if a
+ * tensor does not become real (a gate that does not map hermitian operators to hermitian operators)
+ */
+    double ContractionTools::ContractPauliBasis(const std::vector<std::pair<int, int>> &sequence) {
+        //the network of this object is left as it is - the tensors are read from a clone
+        std::shared_ptr<Network> myNetwork;
+        if (!mCopyCreated) {
+            myNetwork = std::make_shared<Network>(mString, mMeasureFile);
+            myNetwork->SetNumThreads(mNumThreadsInNetwork);
+        } else {
+            myNetwork = mNetwork->Clone();
+        }
+        if (myNetwork->HasFailed()) //if you fail to open the network
+        {
+            return mFinalVal.real();
+        }
+        int numNodes(myNetwork->GetAllNodes().size());
+        std::vector<std::vector<const Wire *>> wires(SequenceWires(myNetwork, sequence));
+
+        //index a = 2i + j of a wire is |i><j|. The node a wire comes out of takes Tr(P rho) = sum of P_ji rho_ij, and the
+        //node it goes into takes the inverse, P_ij / 2, so that the two changes of basis cancel on every wire
+        const std::complex<double> i(0, 1);
+        const std::vector<std::vector<std::complex<double>>> paulis{{1, 0, 0, 1}, {0, 1, 1, 0}, {0, -i, i, 0},
+                                                                    {1, 0, 0, -1}};
+        std::vector<std::vector<std::complex<double>>> fromOut(4, std::vector<std::complex<double>>(4));
+        std::vector<std::vector<std::complex<double>>> fromIn(4, std::vector<std::complex<double>>(4));
+        for (int p(0); p < 4; ++p) {
+            for (int a(0); a < 4; ++a) {
+                fromOut[p][a] = paulis[p][2 * (a % 2) + a / 2];
+                fromIn[p][a] = paulis[p][a] / 2.0;
+            }
+        }
+
+        std::vector<std::vector<double>> tensors(wires.size());
+        for (int n(0); n < numNodes; ++n) {
+            const std::shared_ptr<Node> &node = myNetwork->GetAllNodes()[n];
+            if (node->mContracted) {
+                continue;
+            }
+            std::vector<std::complex<double>> vals(node->GetTensorVals());
+            //change the basis of one index at a time
+            for (int index(0); index < node->mRank; ++index) {
+                const std::shared_ptr<Wire> &tempWire = node->GetWires()[index];
+                const std::vector<std::vector<std::complex<double>>> &change(
+                        tempWire->GetNodeA().lock() == node ? fromOut : fromIn);
+                long long stride(1LL << (2 * index));
+                std::vector<std::complex<double>> changed(vals.size(), 0.0);
+                for (long long v(0); v < vals.size(); ++v) {
+                    long long digit((v / stride) % 4);
+                    for (int p(0); p < 4; ++p) {
+                        changed[v + (p - digit) * stride] += change[p][digit] * vals[v];
+                    }
+                }
+                vals.swap(changed);
+            }
+            for (const auto &val: vals) {
+                if (std::abs(val.imag()) > 1e-9 * std::max(1.0, std::abs(val.real()))) {
+                    throw ContractionFailure();
+                }
+                tensors[n].push_back(val.real());
+            }
+        }
+        for (int step(0); step < sequence.size(); ++step) {
+            int a(sequence[step].first);
+            int b(sequence[step].second);
+            tensors[numNodes + step].resize(1LL << (2 * wires[numNodes + step].size()));
+            ContractTensors(tensors[a].data(), wires[a], tensors[b].data(), wires[b], wires[numNodes + step],
+                            tensors[numNodes + step].data());
+            std::vector<double>().swap(tensors[a]);
+            std::vector<double>().swap(tensors[b]);
+        }
+        mFinalVal = tensors.back()[0];
+        return mFinalVal.real();
+    }
+
+/*This function returns the wire on each index of every node of a contraction sequence - the nodes of the network, then
+ * the node created by each step. The wires of both nodes of a step are summed over, and the others are kept (those of the
+ * first node first). Throws if the sequence does not contract the uncontracted nodes of the network to a single number
+ */
+    std::vector<std::vector<const Wire *>>
+    ContractionTools::SequenceWires(std::shared_ptr<Network> &network, const std::vector<std::pair<int, int>> &sequence) {
+        int numNodes(network->GetAllNodes().size());
+        if (sequence.empty()) {
+            throw InvalidUserContractionSequence();
+        }
+        std::vector<std::vector<const Wire *>> wires(numNodes + sequence.size());
+        std::vector<bool> available(numNodes + sequence.size(), false);
+        for (int i(0); i < numNodes; ++i) {
+            const std::shared_ptr<Node> &node = network->GetAllNodes()[i];
+            if (node->mContracted) {
+                continue;
+            }
+            available[i] = true;
+            for (const auto &tempWire: node->GetWires()) {
+                wires[i].push_back(tempWire.get());
+            }
+        }
+        for (int i(0); i < sequence.size(); ++i) {
+            int a(sequence[i].first);
+            int b(sequence[i].second);
+            if (a < 0 || a >= numNodes + i || b < 0 || b >= numNodes + i || a == b || !available[a] || !available[b]) {
+                throw InvalidUserContractionSequence();
+            }
+            available[a] = available[b] = false;
+            available[numNodes + i] = true;
+            for (const Wire *tempWire: wires[a]) {
+                if (std::find(wires[b].begin(), wires[b].end(), tempWire) == wires[b].end()) {
+                    wires[numNodes + i].push_back(tempWire);
+                }
+            }
+            for (const Wire *tempWire: wires[b]) {
+                if (std::find(wires[a].begin(), wires[a].end(), tempWire) == wires[a].end()) {
+                    wires[numNodes + i].push_back(tempWire);
+                }
+            }
+        }
+        if (!wires.back().empty()) {
+            throw ContractionFailure();
+        }
+        return wires;
+    }
+
+//this function contracts two tensors given the wire on each of their indices: the result has an index for each of wiresC,
+//and every other wire is summed over. A wire of the result may belong to either tensor (or both, without being summed).
+//With a batch size above 1 the tensors are stacks of batchSize blocks (the batch index slowest), and each block of the
+//result comes from the same block of the inputs - an input that is not batched is used for every block. The values may be
+//complex, real (see ContractPauliBasis) or stored in single precision - the sums are always accumulated in double precision
+    template<typename T>
+    void ContractionTools::ContractTensors(const T *valsA, const std::vector<const Wire *> &wiresA,
+                                           const T *valsB, const std::vector<const Wire *> &wiresB,
+                                           const std::vector<const Wire *> &wiresC, T *valsC,
+                                           const int batchSize, const bool batchedA, const bool batchedB) {
+        //the stride of every wire in each tensor - the wires summed over come first, then the wires of C
+        std::vector<const Wire *> allWires;
+        for (const Wire *tempWire: wiresA) {
+            if (std::find(wiresC.begin(), wiresC.end(), tempWire) == wiresC.end()) {
+                allWires.push_back(tempWire);
+            }
+        }
+        for (const Wire *tempWire: wiresB) {
+            if (std::find(wiresC.begin(), wiresC.end(), tempWire) == wiresC.end() &&
+                std::find(allWires.begin(), allWires.end(), tempWire) == allWires.end()) {
+                allWires.push_back(tempWire);
+            }
+        }
+        long long sizeSummed(1LL << (2 * allWires.size()));
+        allWires.insert(allWires.end(), wiresC.begin(), wiresC.end());
+        auto stride = [](const std::vector<const Wire *> &tensorWires, const Wire *tempWire) -> long long {
+            auto found = std::find(tensorWires.begin(), tensorWires.end(), tempWire);
+            return found == tensorWires.end() ? 0 : 1LL << (2 * (found - tensorWires.begin()));
+        };
+        std::vector<long long> stridesA, stridesB;
+        for (const Wire *tempWire: allWires) {
+            stridesA.push_back(stride(wiresA, tempWire));
+            stridesB.push_back(stride(wiresB, tempWire));
+        }
+
+        long long sizeC(1LL << (2 * wiresC.size()));
+        long long blockA(batchedA ? 1LL << (2 * wiresA.size()) : 0);
+        long long blockB(batchedB ? 1LL << (2 * wiresB.size()) : 0);
+        std::vector<int> digits(allWires.size(), 0);
+        long long indexA(0), indexB(0);
+        for (int batch(0); batch < batchSize; ++batch) {
+            //the odometer wraps back to zero after each block
+            const T *blockValsA = valsA + batch * blockA;
+            const T *blockValsB = valsB + batch * blockB;
+            T *blockValsC = valsC + batch * sizeC;
+            for (long long c(0); c < sizeC; ++c) {
+                typename AccumulatorType<T>::type sum(0.0);
+                for (long long s(0); s < sizeSummed; ++s) {
+                    sum += typename AccumulatorType<T>::type(blockValsA[indexA]) *
+                           typename AccumulatorType<T>::type(blockValsB[indexB]);
+                    //advance the digits like an odometer, the first wire fastest - this carries into the wires of C
+                    for (int k(0); k < digits.size(); ++k) {
+                        indexA += stridesA[k];
+                        indexB += stridesB[k];
+                        if (++digits[k] < 4) {
+                            break;
+                        }
+                        indexA -= 4 * stridesA[k];
+                        indexB -= 4 * stridesB[k];
+                        digits[k] = 0;
+                    }
+                }
+                blockValsC[c] = T(sum);
+            }
+        }
+    }
+
+//this function marks the steps of a sequence whose subtree contains a measurement node, and contracts the other steps on
+//the network - they are the same for every measurement. Returns the id each planned node got in the network
+    std::vector<int> ContractionTools::ContractMeasurementIndependentSteps(std::shared_ptr<Network> &network,
+                                                                          const std::vector<std::pair<int, int>> &sequence,
+                                                                          std::vector<bool> &dependsOnMeasurement) {
+        //node i of the plan is created by step i - numNodes
+        int numNodes(network->GetAllNodes().size());
+        dependsOnMeasurement.assign(numNodes + sequence.size(), false);
+        for (int i(0); i < network->GetNumQubits(); ++i) {
+            dependsOnMeasurement[network->GetMeasurementNode(i)->mID] = true;
+        }
+        for (int i(0); i < sequence.size(); ++i) {
+            if (sequence[i].first < 0 || sequence[i].first >= numNodes + i || sequence[i].second < 0 ||
+                sequence[i].second >= numNodes + i) {
+                throw InvalidUserContractionSequence();
+            }
+            dependsOnMeasurement[numNodes + i] =
+                    dependsOnMeasurement[sequence[i].first] || dependsOnMeasurement[sequence[i].second];
+        }
+
+        std::vector<int> idMap(numNodes + sequence.size());
+        std::iota(idMap.begin(), idMap.end(), 0);
+        for (int i(0); i < sequence.size(); ++i) {
+            if (!dependsOnMeasurement[numNodes + i]) {
+                ContractSequenceStep(network, sequence, idMap, i);
+            }
+        }
+        return idMap;
+    }
+
+//this function contracts one step of a sequence on a network. idMap holds the id each planned node got in this network,
+//and -1 for planned nodes made only of open measurement nodes (see ReducedDensityMatrix) - a step with one of those just
+//passes the other node on
+    void ContractionTools::ContractSequenceStep(std::shared_ptr<Network> &network,
+                                                const std::vector<std::pair<int, int>> &sequence,
+                                                std::vector<int> &idMap, const int step) {
+        int numNodes(idMap.size() - sequence.size());
+        int idA(idMap[sequence[step].first]);
+        int idB(idMap[sequence[step].second]);
+        if (idA < 0 || idB < 0) {
+            idMap[numNodes + step] = std::max(idA, idB);
+            return;
+        }
+        std::shared_ptr<Node> result = network->ContractNodes(network->GetAllNodes()[idA], network->GetAllNodes()[idB],
+                                                              100);
+        if (result == nullptr && !network->IsDone()) {
+            throw ContractionFailure();
+        }
+        idMap[numNodes + step] = network->GetAllNodes().size() - 1;
+    }
+
 /*
  *
  * It would, based on the size on the graph, calculate the cost of n random connections.
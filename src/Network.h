@@ -42,20 +42,56 @@ See the License for the specific language governing permissions and
 #include <iostream>
 #include <csignal>
 #include "Exceptions.h"
+#include <unordered_map>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 
 namespace qtorch {
 
 #define THRESH_RANK_THREAD 8  // If rank of resulting threshold is >= this, it will use pthread.
+#define SPARSE_DENSITY_THRESHOLD 0.25 // a node with at most this fraction of nonzero values is contracted by its nonzeros
+#define TIME_CHECK_INTERVAL 4096 // values a fast contraction kernel handles between checks of maxTime
+#define SNAPSHOT_MAGIC "QTSNAP01" // first 8 bytes of every binary network snapshot (see Network::SaveSnapshot)
+#define SNAPSHOT_VERSION 3
     Timer totTimer;
     double maxTime(60.0);
 
 
+/*
+ * A Gate describes one gate of a circuit built in memory (see the Network constructor taking a vector of gates). The names
+ * and qubit orders are the same as in a qasm file, e.g. Gate("CNOT", {0, 1}) is "CNOT 0 1" and Gate("Rz", {2}, 0.5) is
+ * "Rz 0.5 2". The angle of a rotation/phase gate can instead be bound to a parameter slot, like "$k" in a qasm file, by
+ * setting parameterSlot (and optionally parameterScale). A gate with any other name is an arbitrary unitary given by its 4
+ * (one qubit) or 16 (two qubits) row major matrix entries
+ */
+    struct Gate {
+        Gate(const std::string &name0, const std::vector<int> &qubits0, const double angle0 = 0.0) : name(name0),
+                                                                                                  qubits(qubits0),
+                                                                                                  angle(angle0) {};
+
+        Gate(const std::string &name0, const std::vector<int> &qubits0,
+             const std::vector<std::complex<double>> &matrix0) : name(name0), qubits(qubits0), matrix(matrix0) {};
+
+        std::string name;
+        std::vector<int> qubits;
+        double angle{0.0};
+        int parameterSlot{-1}; //the gate takes its angle from parameterScale * parameter[parameterSlot] if this is >= 0
+        double parameterScale{1.0};
+        std::vector<std::complex<double>> matrix;
+    };
+
+
     class Network {
     public:
         Network();  // Empty constructor, npds 2feb2017
         Network(const std::string &inputFile, const std::string &measureFile);
 
+        Network(const int numQubits, const std::vector<Gate> &gates, const std::vector<char> &measurements = {});
+
         std::shared_ptr<Node> ContractNodes(std::shared_ptr<Node> nodeA, std::shared_ptr<Node> nodeB, int threshold);
 
         const std::complex<double> &GetFinalValue() const noexcept { return mFinalVal; };
@@ -76,6 +112,8 @@ namespace qtorch {
 
         void ReduceCircuit();
 
+        void AbsorbBoundaryNodes();
+
         void OutputCircuitToVisualGraph(const std::string &toOutputTo) const;
 
         void OutputCircuitToTreewidthGraph(const std::string &toOutputTo) const;
@@ -86,6 +124,30 @@ namespace qtorch {
 
         const std::string &GetInputQasm() const noexcept { return mInputFile; };
 
+        std::shared_ptr<Network> Clone() const;
+
+        void BindParameters(const std::vector<double> &parameters);
+
+        const int GetNumParameters() const noexcept;
+
+        const std::vector<double> &GetParameters() const noexcept { return mParameters; };
+
+        void SaveSnapshot(const std::string &snapshotFile) const;
+
+        void LoadSnapshot(const std::string &snapshotFile);
+
+        static bool IsSnapshotFile(const std::string &path);
+
+        const std::shared_ptr<Node> &GetMeasurementNode(const int qubit) const;
+
+        void SetMeasurement(const int qubit, const char measurement);
+
+        void OpenQubit(const int qubit);
+
+        std::vector<std::complex<double>> GetReducedDensityMatrix() const;
+
+        static std::shared_ptr<Node> CreateMeasurementNode(const char measurement);
+
         void resetFloatCounter() noexcept { mNumFloatOps = 0; };
 
         long long getNumFloatOps() noexcept { return mNumFloatOps; };
@@ -94,6 +156,8 @@ namespace qtorch {
         std::vector<std::shared_ptr<Wire>> mNetworkParsingWires; //keeps track of the furthest wire on each line in the circuit when building (**** becomes useless after building ****)
         std::string mInputFile; //the path to the input qasm file
         std::string mMeasureFile; //the path to the input measure file
+        std::shared_ptr<const std::vector<Gate>> mGates; //the circuit, if the network was built in memory - shared by clones
+        std::vector<char> mMeasurements; //the measurements, if the network was built in memory
         std::complex<double> mFinalVal{std::complex<double>(0.0)}; //the final expectation value of the network
         std::mutex mLocker; //mutex to avoid errors when parallelizing calls to contract nodes
         int mNumberOfQubits; //the number of qubits in the network
@@ -102,12 +166,16 @@ namespace qtorch {
         bool mFailure{false}; //if the network fails to contract for some reason
         std::vector<std::shared_ptr<Node>> mAllNodes; //a vector with all the nodes in the circuit, including ones that have already been contracted.
         std::vector<std::vector<std::shared_ptr<Node>>> mNodesByWire; //a matrix that contains the nodes in the circuit in their respective places - a way to realize the 2d circuit
+        std::vector<int> mQubitLines; //the line of mNodesByWire that carries each qubit - a SWAP exchanges two entries instead of moving the nodes
         std::vector<std::shared_ptr<Node>> mUncontractedNodes; //a vector with just the nodes that haven't been contracted yet
         std::unordered_map<std::string, std::string> mArbitraryOneQubitGates; //a vector with arbitrary one qubit gates that have been defined in the qasm file - see the node class for more info on this
         std::unordered_map<std::string, std::string> mArbitraryTwoQubitGates; //a vector with arbitrary two qubit gates that have been defined in the qasm file - see the node class for more info on this
+        std::unordered_map<std::string, std::shared_ptr<std::complex<double>>> mArbitraryGateTensors; //the tensor of each arbitrary gate used so far, shared by all its nodes
         long long mNumFloatOps{
                 0}; // Counting floating ops. Should probably be reset after the simple "network reduction" routine.
         int mNumberOfThreads{8};
+        std::vector<std::shared_ptr<Node>> mParameterizedNodes; //gates whose angle refers to a parameter slot ($k in the qasm file)
+        std::vector<double> mParameters; //the values last bound to the parameter slots - reapplied when the network is reset
     protected:
         inline void ContractIndices(const std::vector<std::pair<bool, int>> &toNotSumOn,
                                     const std::vector<std::pair<int, int>> &toSumOn,
@@ -117,12 +185,52 @@ namespace qtorch {
                                     std::shared_ptr<Node> nodeB,
                                     std::shared_ptr<Node> nodeC);
 
+        bool ContractDiagonalNode(const std::vector<std::pair<bool, int>> &toNotSumOn,
+                                  const std::vector<std::pair<int, int>> &toSumOn,
+                                  const std::shared_ptr<Node> &nodeA, const std::shared_ptr<Node> &nodeB,
+                                  const std::complex<double> *valsA, const std::complex<double> *valsB,
+                                  std::complex<double> *valsC) const;
+
+        bool ContractPermutationNode(const std::vector<std::pair<bool, int>> &toNotSumOn,
+                                     const std::vector<std::pair<int, int>> &toSumOn,
+                                     const std::shared_ptr<Node> &nodeA, const std::shared_ptr<Node> &nodeB,
+                                     const std::complex<double> *valsA, const std::complex<double> *valsB,
+                                     std::complex<double> *valsC) const;
+
+        bool ContractBoundaryNode(const std::vector<std::pair<bool, int>> &toNotSumOn,
+                                  const std::vector<std::pair<int, int>> &toSumOn,
+                                  const std::shared_ptr<Node> &nodeA, const std::shared_ptr<Node> &nodeB,
+                                  const std::complex<double> *valsA, const std::complex<double> *valsB,
+                                  std::complex<double> *valsC) const;
+
+        bool ContractSparseNodes(const std::vector<std::pair<bool, int>> &toNotSumOn,
+                                 const std::vector<std::pair<int, int>> &toSumOn,
+                                 const std::shared_ptr<Node> &nodeA, const std::shared_ptr<Node> &nodeB,
+                                 const std::complex<double> *valsA, const std::complex<double> *valsB,
+                                 std::complex<double> *valsC) const;
+
         void ParseTokens(std::string &input, std::vector<std::string> &output);
 
         void ParseNetwork(const std::string &inputFile);
 
+        void ClearNetwork();
+
+        void BuildNetwork();
+
         void ParseNode(std::string &inputLine);
 
+        void ParseAngle(const std::string &token, Gate &gate);
+
+        const int GetGateNumQubits(const Gate &gate) const;
+
+        void AddGate(const Gate &gate);
+
+        void AttachOneQubitNode(std::shared_ptr<Node> &newNode, const int line);
+
+        void AttachTwoQubitNode(std::shared_ptr<Node> &newNode, const int lineOne, const int lineTwo);
+
+        void AddParameterizedNode(std::shared_ptr<Node> &newNode, int slot, double scale);
+
         void CreateInitialStates();
 
         void AddMeasurementsOrTrace(std::vector<char> &measurements);
@@ -150,8 +258,29 @@ namespace qtorch {
         ParseNetwork(inputFile);
     }
 
+//constructor - builds the network from a circuit held in memory instead of a qasm file. measurements[i] is the measurement
+//on qubit i, using the same characters as a measurement file - qubits without one are traced out
+    Network::Network(const int numQubits, const std::vector<Gate> &gates, const std::vector<char> &measurements) :
+            mGates(std::make_shared<const std::vector<Gate>>(gates)), mMeasurements(measurements) {
+        mNumberOfQubits = numQubits;
+        BuildNetwork();
+    }
+
 //this function resets all the data in the class and calls the ParseNetwork function again to regenerate the network
     void Network::Reset() {
+        int numQubits(mNumberOfQubits);
+        ClearNetwork();
+        if (mGates) {
+            mNumberOfQubits = numQubits;
+            BuildNetwork();
+        } else {
+            ParseNetwork(mInputFile);
+        }
+        //clear everything except for mInputFile (or the circuit built in memory) and regenerate the network.
+    }
+
+//this function clears all the data in the class except for the input and measurement file paths
+    void Network::ClearNetwork() {
         mNetworkParsingNodes.clear();
         mNetworkParsingWires.clear();
         mFinalVal = std::complex<double>(0.0);
@@ -161,13 +290,13 @@ namespace qtorch {
         mFailure = false;
         mAllNodes.clear();
         mNodesByWire.clear();
+        mQubitLines.clear();
         mUncontractedNodes.clear();
         mArbitraryOneQubitGates.clear();
         mArbitraryTwoQubitGates.clear();
-
-
-        ParseNetwork(mInputFile);
-        //clear everything except for mInputFile and call ParseNetwork.
+        mArbitraryGateTensors.clear();
+        mParameterizedNodes.clear();
+        mNumFloatOps = 0;
     }
 
 
@@ -188,6 +317,7 @@ namespace qtorch {
             mAllNodes.push_back(temNode);
             temNode->AddWireNumber(i);
             mNodesByWire[i].push_back(temNode);
+            mQubitLines.push_back(i);
             temNode->mID = mAllNodes.size() - 1;
         }
 
@@ -197,53 +327,134 @@ namespace qtorch {
 //This function takes in a vector of measurements on each qubit to perform each index in the vector corresponds to each qubit
 //to trace out a qubit, the T character is sent. - recognized measurements are X,Y,Z,0,1,T where 0 and 1 are projection ops
     void Network::AddMeasurementsOrTrace(std::vector<char> &measurements) {
-        //Create and add either trace out or measurement operators
+        //Create and add either trace out or measurement operators, each at the end of the line carrying its qubit
         for (int i = 0; i < mNumberOfQubits; i++) {
-            std::shared_ptr<Node> measureNodeTemp;
-            if (measurements.size() <= i) {
+            int line(mQubitLines[i]);
+            std::shared_ptr<Node> measureNodeTemp = CreateMeasurementNode(measurements.size() <= i ? 'T' : measurements[i]);
+            if (measureNodeTemp->GetTypeOfNodeString() == "Trace") {
                 std::cout << "Tracing out qubit: " << i << std::endl;
-                measureNodeTemp = std::make_shared<TraceNode>();
-            } else if (measurements[i] == 'X') //X measurement
-            {
-                std::cout << "Creating X measurement on qubit: " << i << std::endl;
-                measureNodeTemp = std::make_shared<XMeasure>();
-            } else if (measurements[i] == 'Y')//Y measurement
-            {
-                std::cout << "Creating Y measurement on qubit: " << i << std::endl;
-                measureNodeTemp = std::make_shared<YMeasure>();
-            } else if (measurements[i] == 'Z') //Z Measurement
-            {
-                std::cout << "Creating Z measurement on qubit: " << i << std::endl;
-                measureNodeTemp = std::make_shared<ZMeasure>();
-            } else if (measurements[i] == '0') {
-                std::cout << "Creating Projection |0><0| measurement on qubit: " << i << std::endl;
-                measureNodeTemp = std::make_shared<ProjectZero>();
-            } else if (measurements[i] == '1') {
-                std::cout << "Creating Projection |1><1| measurement on qubit: " << i << std::endl;
-                measureNodeTemp = std::make_shared<ProjectOne>();
-            } else //Trace out/I measurement
-            {
-                std::cout << "Tracing out qubit: " << i << std::endl;
-                measureNodeTemp = std::make_shared<TraceNode>();
+            } else {
+                std::cout << "Creating " << measureNodeTemp->GetTypeOfNodeString() << " on qubit: " << i << std::endl;
             }
 
             //add the measurement and connect it
-            mNetworkParsingWires[i]->SetNodeB(measureNodeTemp);
-            measureNodeTemp->GetWires().push_back(mNetworkParsingWires[i]);
+            mNetworkParsingWires[line]->SetNodeB(measureNodeTemp);
+            measureNodeTemp->GetWires().push_back(mNetworkParsingWires[line]);
             mAllNodes.push_back(measureNodeTemp);
-            measureNodeTemp->AddWireNumber(i);
-            mNodesByWire[i].push_back(measureNodeTemp);
+            measureNodeTemp->AddWireNumber(line);
+            mNodesByWire[line].push_back(measureNodeTemp);
             measureNodeTemp->mID = mAllNodes.size() - 1;
         }
 
 
     }
 
+//this function creates the measurement (or trace) node for one character of a measurement file - anything unrecognized
+//traces the qubit out
+    std::shared_ptr<Node> Network::CreateMeasurementNode(const char measurement) {
+        if (measurement == 'X') //X measurement
+        {
+            return std::make_shared<XMeasure>();
+        } else if (measurement == 'Y')//Y measurement
+        {
+            return std::make_shared<YMeasure>();
+        } else if (measurement == 'Z') //Z Measurement
+        {
+            return std::make_shared<ZMeasure>();
+        } else if (measurement == '0') {
+            return std::make_shared<ProjectZero>();
+        } else if (measurement == '1') {
+            return std::make_shared<ProjectOne>();
+        }
+        //Trace out/I measurement
+        return std::make_shared<TraceNode>();
+    }
+
+//returns the measurement (or trace) node at the end of a qubit's wire
+    const std::shared_ptr<Node> &Network::GetMeasurementNode(const int qubit) const {
+        if (qubit < 0 || qubit >= mQubitLines.size() || mNodesByWire[mQubitLines[qubit]].empty() ||
+            mNodesByWire[mQubitLines[qubit]].back()->GetTypeOfNode() != GateType::MEASURETRACE) {
+            throw InvalidFunctionInput();
+        }
+        return mNodesByWire[mQubitLines[qubit]].back();
+    }
+
+//this function replaces the measurement on a qubit (same characters as a measurement file) without rebuilding the network.
+//The measurement node must not have been contracted yet - use it on a fresh network or a clone (see Clone)
+    void Network::SetMeasurement(const int qubit, const char measurement) {
+        const std::shared_ptr<Node> &measureNode = GetMeasurementNode(qubit);
+        if (measureNode->mContracted) {
+            throw InvalidFunctionInput();
+        }
+        measureNode->ShareTensor(*CreateMeasurementNode(measurement));
+    }
+
+//this function removes the measurement on a qubit, leaving its wire open. The measurement node stays in mAllNodes (so node
+//ids do not change) but is marked as contracted and is never contracted again. Nodes whose wires are all open can be
+//contracted without sharing a wire (an outer product), so the network reduces to a single node - see GetReducedDensityMatrix
+    void Network::OpenQubit(const int qubit) {
+        std::shared_ptr<Node> measureNode = GetMeasurementNode(qubit);
+        if (measureNode->mContracted) {
+            throw InvalidFunctionInput();
+        }
+        for (auto &tempWire: measureNode->GetWires()) {
+            if (tempWire->GetNodeA().lock() == measureNode) {
+                tempWire->SetNodeA(nullptr);
+            } else {
+                tempWire->SetNodeB(nullptr);
+            }
+        }
+        measureNode->mContracted = true;
+        measureNode->ClearNodeData();
+        FindAndRemove(mUncontractedNodes, measureNode);
+    }
+
+//this function returns the tensor left after contracting a network with open qubits: the reduced density matrix of those
+//qubits in the superoperator basis. The index of the j-th open qubit (in ascending order) is digit j of the index (base 4)
+    std::vector<std::complex<double>> Network::GetReducedDensityMatrix() const {
+        if (mUncontractedNodes.size() != 1) {
+            throw ContractionFailure();
+        }
+        const std::shared_ptr<Node> &finalNode = mUncontractedNodes.front();
+
+        //the digit of each index of the final node in the result - the wires are numbered by line, not by qubit
+        std::vector<int> qubitOnLine(mQubitLines.size());
+        for (int qubit = 0; qubit < mQubitLines.size(); qubit++) {
+            qubitOnLine[mQubitLines[qubit]] = qubit;
+        }
+        std::vector<int> qubits;
+        for (const auto &tempWire: finalNode->GetWires()) {
+            qubits.push_back(qubitOnLine[tempWire->GetQubitNumber()]);
+        }
+        std::vector<int> sortedQubits(qubits);
+        std::sort(sortedQubits.begin(), sortedQubits.end());
+        std::vector<int> digits;
+        for (int qubit: qubits) {
+            digits.push_back(std::lower_bound(sortedQubits.begin(), sortedQubits.end(), qubit) - sortedQubits.begin());
+        }
+
+        const std::complex<double> *vals = finalNode->GetTensorData();
+        std::vector<std::complex<double>> rdm(finalNode->GetNumTensorVals());
+        for (long long i = 0; i < rdm.size(); i++) {
+            long long index(0);
+            for (int j = 0; j < digits.size(); j++) {
+                index += ((i >> (2 * j)) % 4) << (2 * digits[j]);
+            }
+            rdm[index] = vals[i];
+        }
+        return rdm;
+    }
+
 
 //This function takes in the qasm input file and parses it, adding nodes to the circuit for the initial states, each gate
 //, and then finally measurements - modify the test case file measureTest.txt to modify the measurements or modify the function below, so
 //the user has to specify the measurement file when creating the network
     void Network::ParseNetwork(const std::string &inputFile) {
+        //a binary snapshot can be used anywhere a qasm file can - it already contains the measurements
+        if (IsSnapshotFile(inputFile)) {
+            LoadSnapshot(inputFile);
+            return;
+        }
         mAllNodes.reserve(1000000);
         std::ifstream input(inputFile);
         if (!input.is_open()) {
@@ -303,339 +514,490 @@ namespace qtorch {
         mUncontractedNodes = mAllNodes;
     }
 
-
-//this function contracts the tensor network in the order of creation of nodes - use this only to test. Otherwise, use the
-//functions in the parallelizer wrapper class
-    void Network::ContractNetworkLinearly() {
-        std::shared_ptr<Node> temp;
-        while (!mDone) {
-            if(!mUncontractedNodes[0]->GetWires()[0]->GetNodeA().expired() && !mUncontractedNodes[0]->GetWires()[0]->GetNodeB().expired())
-            {
-                std::shared_ptr<Node> tempA(mUncontractedNodes[0]->GetWires()[0]->GetNodeA().lock());
-                std::shared_ptr<Node> tempB(mUncontractedNodes[0]->GetWires()[0]->GetNodeB().lock());
-                ContractNodes(tempA, tempB, 1000);
-            } else
-            {
-                throw InvalidContractionMethod();
-            }
+//This function generates the network from the circuit held in memory (mGates and mMeasurements) - it is the in memory
+//counterpart of ParseNetwork, so the resulting network is identical to parsing the same circuit from files
+    void Network::BuildNetwork() {
+        if (mNumberOfQubits < 1) {
+            mFailure = true;
+            throw InvalidFunctionInput();
         }
-    }
+        mNodesByWire.resize(mNumberOfQubits);
+        CreateInitialStates();
+        for (const auto &gate: *mGates) {
+            AddGate(gate);
+        }
+        std::vector<char> measurements(mMeasurements);
+        AddMeasurementsOrTrace(measurements);
 
+        mNetworkParsingNodes.clear();
+        mNetworkParsingWires.clear();
+        mUncontractedNodes = mAllNodes;
+    }
 
-//this function takes in a line from the qasm file and parses it, creating the appropriate node or arbitrary gate definition
-    void Network::ParseNode(std::string &inputLine) {
-        // std::cout<<"Attempting To Parse A Node"<<std::endl;
-        std::vector<std::string> parsedLine;
-        //parse the line into tokens (with a space as the delimiter
-        ParseTokens(inputLine, parsedLine);
 
-        if (parsedLine.size() == 0) {
-            return;
+/*This function returns an independent copy of the network in its current state (parsed, reduced or partially contracted).
+ * The nodes and wires are copied, but the tensor values are shared with this network copy-on-write: a node only copies its
+ * values when they are written to (see Node::Index), so cloning costs about as much as copying the topology. Either network
+ * can then be contracted without affecting the other
+ */
+    std::shared_ptr<Network> Network::Clone() const {
+        std::shared_ptr<Network> clone = std::make_shared<Network>();
+        std::unordered_map<const Node *, std::shared_ptr<Node>> nodeMap;
+        std::vector<std::shared_ptr<Node>> toVisit(mAllNodes);
+        std::copy(mUncontractedNodes.begin(), mUncontractedNodes.end(), std::back_inserter(toVisit));
+        for (const auto &tempVect: mNodesByWire) {
+            std::copy(tempVect.begin(), tempVect.end(), std::back_inserter(toVisit));
         }
-        std::shared_ptr<Node> newNode;
-
-        if (parsedLine[0] == "Rx" || parsedLine[0] == "RX") //if the line is an Rx gate
-        {
-            //Rx 3.1415 0 = Rx(pi) on qubit 0
 
-            //convert the phase to a float
-            float tempPhaseVal{std::stof(parsedLine[1])};
+        //copy every node the network can reach, following the wires to nodes that are not stored in any vector
+        while (!toVisit.empty()) {
+            std::shared_ptr<Node> original(toVisit.back());
+            toVisit.pop_back();
+            if (original == nullptr || nodeMap.find(original.get()) != nodeMap.end()) {
+                continue;
+            }
+            nodeMap.insert({original.get(), std::make_shared<Node>(*original)});
+            for (const auto &tempWire: original->GetWires()) {
+                toVisit.push_back(tempWire->GetNodeA().lock());
+                toVisit.push_back(tempWire->GetNodeB().lock());
+            }
+        }
+        auto mapNode = [&nodeMap](const std::shared_ptr<Node> &original) -> std::shared_ptr<Node> {
+            auto found = nodeMap.find(original.get());
+            return (original == nullptr || found == nodeMap.end()) ? nullptr : found->second;
+        };
 
-            //to debug
-            //std::cout<<"Created Rx Node..."<<std::endl;
+        //copy the wires and point the copied nodes at them
+        std::unordered_map<const Wire *, std::shared_ptr<Wire>> wireMap;
+        for (auto &copied: nodeMap) {
+            for (auto &tempWire: copied.second->GetWires()) {
+                auto found = wireMap.find(tempWire.get());
+                if (found == wireMap.end()) {
+                    std::shared_ptr<Wire> newWire = std::make_shared<Wire>(*tempWire);
+                    newWire->SetNodeA(mapNode(tempWire->GetNodeA().lock()));
+                    newWire->SetNodeB(mapNode(tempWire->GetNodeB().lock()));
+                    found = wireMap.insert({tempWire.get(), newWire}).first;
+                }
+                tempWire = found->second;
+            }
+        }
 
-            //create the Rx Node
-            newNode = std::make_shared<RxNode>(tempPhaseVal);
+        clone->mInputFile = mInputFile;
+        clone->mMeasureFile = mMeasureFile;
+        clone->mGates = mGates;
+        clone->mMeasurements = mMeasurements;
+        clone->mFinalVal = mFinalVal;
+        clone->mNumberOfQubits = mNumberOfQubits;
+        clone->mDepth = mDepth;
+        clone->mDone = mDone;
+        clone->mFailure = mFailure;
+        clone->mArbitraryOneQubitGates = mArbitraryOneQubitGates;
+        clone->mArbitraryTwoQubitGates = mArbitraryTwoQubitGates;
+        clone->mNumFloatOps = mNumFloatOps;
+        clone->mNumberOfThreads = mNumberOfThreads;
+        clone->mParameters = mParameters;
+        std::transform(mParameterizedNodes.begin(), mParameterizedNodes.end(),
+                       std::back_inserter(clone->mParameterizedNodes), mapNode);
+        clone->mAllNodes.reserve(mAllNodes.size());
+        std::transform(mAllNodes.begin(), mAllNodes.end(), std::back_inserter(clone->mAllNodes), mapNode);
+        clone->mUncontractedNodes.reserve(mUncontractedNodes.size());
+        std::transform(mUncontractedNodes.begin(), mUncontractedNodes.end(),
+                       std::back_inserter(clone->mUncontractedNodes), mapNode);
+        clone->mNodesByWire.resize(mNodesByWire.size());
+        for (int i = 0; i < mNodesByWire.size(); i++) {
+            std::transform(mNodesByWire[i].begin(), mNodesByWire[i].end(),
+                           std::back_inserter(clone->mNodesByWire[i]), mapNode);
+        }
+        clone->mQubitLines = mQubitLines;
+        return clone;
+    }
 
-            //convert the qubit index to an int
-            int tempQubitValOne{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
-                throw InvalidFileFormat();
+/*This function writes the network, as it is right now (e.g. right after parsing or after ReduceCircuit), to a binary
+ * snapshot file. The file holds the topology as flat arrays of node and wire indices, followed by the tensor values of
+ * every node, so LoadSnapshot can map the file and use the values in place without re-parsing or re-reducing the circuit.
+ * The layout is the native byte order of the machine, so snapshots are meant to be reused on the machine that wrote them
+ */
+    void Network::SaveSnapshot(const std::string &snapshotFile) const {
+        //number every node the network can reach - mAllNodes keep their position so node IDs and sequences stay valid
+        std::vector<std::shared_ptr<Node>> nodes(mAllNodes);
+        std::unordered_map<const Node *, long long> nodeIndex;
+        for (long long i = 0; i < nodes.size(); i++) {
+            nodeIndex.insert({nodes[i].get(), i});
+        }
+        auto addNode = [&nodes, &nodeIndex](const std::shared_ptr<Node> &toAdd) {
+            if (toAdd != nullptr && nodeIndex.find(toAdd.get()) == nodeIndex.end()) {
+                nodeIndex.insert({toAdd.get(), static_cast<long long>(nodes.size())});
+                nodes.push_back(toAdd);
             }
+        };
+        std::for_each(mUncontractedNodes.begin(), mUncontractedNodes.end(), addNode);
+        for (const auto &tempVect: mNodesByWire) {
+            std::for_each(tempVect.begin(), tempVect.end(), addNode);
+        }
+        auto indexOfNode = [&nodeIndex](const std::shared_ptr<Node> &toFind) -> long long {
+            auto found = nodeIndex.find(toFind.get());
+            return (toFind == nullptr || found == nodeIndex.end()) ? -1 : found->second;
+        };
 
-            //add the current hanging wire to the node
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
+        //number every wire attached to those nodes
+        std::vector<std::shared_ptr<Wire>> wires;
+        std::unordered_map<const Wire *, long long> wireIndex;
+        for (const auto &tempNode: nodes) {
+            for (const auto &tempWire: tempNode->GetWires()) {
+                if (wireIndex.find(tempWire.get()) == wireIndex.end()) {
+                    wireIndex.insert({tempWire.get(), static_cast<long long>(wires.size())});
+                    wires.push_back(tempWire);
+                }
+            }
+        }
 
-            //add the node to the current hanging wire
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
+        //topology and node data
+        std::string meta;
+        auto putInt = [&meta](long long toPut) { meta.append(reinterpret_cast<const char *>(&toPut), sizeof(toPut)); };
+        auto putDouble = [&meta](double toPut) { meta.append(reinterpret_cast<const char *>(&toPut), sizeof(toPut)); };
+        auto putString = [&meta, &putInt](const std::string &toPut) {
+            putInt(toPut.size());
+            meta.append(toPut);
+        };
 
-            //create a new hanging wire
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
+        putInt(mNumberOfQubits);
+        putInt(mDepth);
+        putInt(mDone);
+        putDouble(mFinalVal.real());
+        putDouble(mFinalVal.imag());
+        putInt(mNumFloatOps);
+
+        putInt(wires.size());
+        for (const auto &tempWire: wires) {
+            putInt(indexOfNode(tempWire->GetNodeA().lock()));
+            putInt(indexOfNode(tempWire->GetNodeB().lock()));
+            putInt(tempWire->GetQubitNumber());
+            putInt(tempWire->GetWireID());
+            putInt(tempWire->IsContracted());
+        }
 
-            //set the current hanging wire to the new wire
-            mNetworkParsingWires[tempQubitValOne] = newWire;
+        long long payloadSize(0);
+        putInt(mAllNodes.size());
+        putInt(nodes.size());
+        for (const auto &tempNode: nodes) {
+            putInt(tempNode->mRank);
+            putInt(static_cast<long long>(tempNode->GetTypeOfNode()));
+            putString(tempNode->GetTypeOfNodeString());
+            putInt(tempNode->mID);
+            putInt(tempNode->mIndexOfPreviousNode);
+            putInt(tempNode->mCreatedFrom.first);
+            putInt(tempNode->mCreatedFrom.second);
+            putInt(tempNode->mContracted);
+            putInt(tempNode->mSelectedInCostContractionAlgorithm);
+            putInt(tempNode->GetWireNumber().size());
+            for (int wireNumber: tempNode->GetWireNumber()) {
+                putInt(wireNumber);
+            }
+            putInt(tempNode->GetWires().size());
+            for (const auto &tempWire: tempNode->GetWires()) {
+                putInt(wireIndex[tempWire.get()]);
+            }
+            putInt(tempNode->mParameterSlot);
+            putDouble(tempNode->mParameterScale);
+            putInt(tempNode->GetNumTensorVals());
+            putInt(payloadSize);
+            payloadSize += tempNode->GetNumTensorVals();
+        }
 
-            //add the hanging wire to the new node
-            newNode->GetWires().push_back(newWire);
+        putInt(mUncontractedNodes.size());
+        for (const auto &tempNode: mUncontractedNodes) {
+            putInt(indexOfNode(tempNode));
+        }
+        putInt(mNodesByWire.size());
+        for (const auto &tempVect: mNodesByWire) {
+            putInt(tempVect.size());
+            for (const auto &tempNode: tempVect) {
+                putInt(indexOfNode(tempNode));
+            }
+        }
+        putInt(mQubitLines.size());
+        std::for_each(mQubitLines.begin(), mQubitLines.end(), putInt);
+        putInt(mParameterizedNodes.size());
+        for (const auto &tempNode: mParameterizedNodes) {
+            putInt(indexOfNode(tempNode));
+        }
+        putInt(mParameters.size());
+        std::for_each(mParameters.begin(), mParameters.end(), putDouble);
+        for (const auto *gates: {&mArbitraryOneQubitGates, &mArbitraryTwoQubitGates}) {
+            putInt(gates->size());
+            for (const auto &gate: *gates) {
+                putString(gate.first);
+                putString(gate.second);
+            }
+        }
 
-            //add the wire number to the new node
-            newNode->AddWireNumber(tempQubitValOne);
+        std::ofstream output(snapshotFile, std::ios::binary);
+        if (!output.is_open()) {
+            std::cout << "Failed to open snapshot file for writing!" << std::endl;
+            throw InvalidFile();
+        }
+        long long header[2] = {SNAPSHOT_VERSION, static_cast<long long>(meta.size())};
+        output.write(SNAPSHOT_MAGIC, 8);
+        output.write(reinterpret_cast<const char *>(header), sizeof(header));
+        output.write(meta.data(), meta.size());
+        //align the tensor values so they can be used straight from the mapping
+        long long position(8 + sizeof(header) + meta.size());
+        const char padding[alignof(std::complex<double>)] = {};
+        output.write(padding, (alignof(std::complex<double>) - position % alignof(std::complex<double>)) %
+                              alignof(std::complex<double>));
+        for (const auto &tempNode: nodes) {
+            output.write(reinterpret_cast<const char *>(tempNode->GetTensorData()),
+                         tempNode->GetNumTensorVals() * sizeof(std::complex<double>));
+        }
+        if (!output.good()) {
+            throw InvalidFile();
+        }
+        output.close();
+    }
 
-            //set the index of the previous node
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
+//this function checks whether a file starts with the snapshot magic bytes
+    bool Network::IsSnapshotFile(const std::string &path) {
+        std::ifstream input(path, std::ios::binary);
+        char magic[8];
+        return input.read(magic, 8) && std::memcmp(magic, SNAPSHOT_MAGIC, 8) == 0;
+    }
 
-            //add the node to mNodes by wire
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-        } else if (parsedLine[0] == "Ry" || parsedLine[0] == "RY") //if the line is an Ry gate
-        {
+/*This function replaces the network with the one stored in a snapshot written by SaveSnapshot. The file is memory mapped
+ * privately and the nodes use their tensor values straight from the mapping (a node copies its values only if they are
+ * written to), so loading costs about as much as reading the topology arrays. Reset() reloads the snapshot
+ */
+    void Network::LoadSnapshot(const std::string &snapshotFile) {
+        int fileDescriptor = open(snapshotFile.c_str(), O_RDONLY);
+        if (fileDescriptor < 0) {
+            std::cout << "Failed to open snapshot file!" << std::endl;
+            mFailure = true;
+            throw InvalidFile();
+        }
+        struct stat fileInfo;
+        if (fstat(fileDescriptor, &fileInfo) != 0 || fileInfo.st_size < 8 + 2 * sizeof(long long)) {
+            close(fileDescriptor);
+            mFailure = true;
+            throw InvalidFileFormat();
+        }
+        std::size_t fileSize(fileInfo.st_size);
+        void *address = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileDescriptor, 0);
+        close(fileDescriptor);
+        if (address == MAP_FAILED) {
+            mFailure = true;
+            throw InvalidFile();
+        }
+        //the mapping stays alive for as long as any node still uses values from it
+        std::shared_ptr<char> mapping(static_cast<char *>(address), [fileSize](char *toUnmap) {
+            munmap(toUnmap, fileSize);
+        });
 
-            //see Rx gate
-            float tempPhaseVal{std::stof(parsedLine[1])};
-            //std::cout<<"Created Ry Node..."<<std::endl;
-            newNode = std::make_shared<RyNode>(tempPhaseVal);
-            int tempQubitValOne{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
+        std::size_t position(0);
+        auto require = [&position, fileSize, this](std::size_t numBytes) {
+            if (position + numBytes > fileSize) {
+                mFailure = true;
                 throw InvalidFileFormat();
             }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWire;
-            newNode->GetWires().push_back(newWire);
+        };
+        auto getInt = [&mapping, &position, &require]() {
+            long long toGet;
+            require(sizeof(toGet));
+            std::memcpy(&toGet, mapping.get() + position, sizeof(toGet));
+            position += sizeof(toGet);
+            return toGet;
+        };
+        auto getDouble = [&mapping, &position, &require]() {
+            double toGet;
+            require(sizeof(toGet));
+            std::memcpy(&toGet, mapping.get() + position, sizeof(toGet));
+            position += sizeof(toGet);
+            return toGet;
+        };
+        auto getString = [&mapping, &position, &require, &getInt]() {
+            long long length(getInt());
+            require(length);
+            std::string toGet(mapping.get() + position, length);
+            position += length;
+            return toGet;
+        };
 
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-        } else if (parsedLine[0] == "Rz" || parsedLine[0] == "RZ") //if the line is an Rz gate
-        {
-            //see Rx gate
-            float tempPhaseVal{std::stof(parsedLine[1])};
-            //std::cout<<"Created Rz Node..."<<std::endl;
-            newNode = std::make_shared<RzNode>(tempPhaseVal);
-            int tempQubitValOne{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
-                throw InvalidFileFormat();
+        if (std::memcmp(mapping.get(), SNAPSHOT_MAGIC, 8) != 0) {
+            mFailure = true;
+            throw InvalidFileFormat();
+        }
+        position = 8;
+        if (getInt() != SNAPSHOT_VERSION) {
+            std::cout << "Snapshot was written by a different version of qTorch" << std::endl;
+            mFailure = true;
+            throw InvalidFileFormat();
+        }
+        long long metaSize(getInt());
+        std::size_t payloadStart(position + metaSize);
+        payloadStart += (alignof(std::complex<double>) - payloadStart % alignof(std::complex<double>)) %
+                        alignof(std::complex<double>);
+
+        ClearNetwork();
+        mInputFile = snapshotFile;
+        mGates.reset();
+        mNumberOfQubits = getInt();
+        mDepth = getInt();
+        mDone = getInt();
+        double finalReal(getDouble());
+        mFinalVal = std::complex<double>(finalReal, getDouble());
+        mNumFloatOps = getInt();
+
+        struct WireRecord {
+            long long nodeA, nodeB, qubit, wireID, contracted;
+        };
+        std::vector<WireRecord> wireRecords(getInt());
+        for (auto &record: wireRecords) {
+            record.nodeA = getInt();
+            record.nodeB = getInt();
+            record.qubit = getInt();
+            record.wireID = getInt();
+            record.contracted = getInt();
+        }
+
+        long long numAllNodes(getInt());
+        std::vector<std::shared_ptr<Node>> nodes(getInt());
+        std::vector<std::vector<long long>> nodeWires(nodes.size());
+        for (int i = 0; i < nodes.size(); i++) {
+            int rank = getInt();
+            GateType type = static_cast<GateType>(getInt());
+            std::string typeString(getString());
+            int id = getInt();
+            int indexOfPreviousNode = getInt();
+            std::pair<int, int> createdFrom;
+            createdFrom.first = getInt();
+            createdFrom.second = getInt();
+            bool contracted = getInt();
+            bool selected = getInt();
+            std::vector<int> wireNumbers(getInt());
+            for (int &wireNumber: wireNumbers) {
+                wireNumber = getInt();
             }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWire;
-            newNode->GetWires().push_back(newWire);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-        } 
-        else if (parsedLine[0] == "PHASE") //if the line is a PHASE gate
-        {
-            //see Rx gate
-            float tempPhaseVal{std::stof(parsedLine[1])};
-            //std::cout<<"Created Phase Node..."<<std::endl;
-            newNode = std::make_shared<PhaseNode>(tempPhaseVal);
-            int tempQubitValOne{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
+            nodeWires[i].resize(getInt());
+            for (long long &wire: nodeWires[i]) {
+                wire = getInt();
+                if (wire < 0 || wire >= wireRecords.size()) {
+                    mFailure = true;
+                    throw InvalidFileFormat();
+                }
+            }
+            int parameterSlot = getInt();
+            double parameterScale = getDouble();
+            long long numVals(getInt());
+            long long offset(getInt());
+            if (numVals < 0 || offset < 0 ||
+                payloadStart + (offset + numVals) * sizeof(std::complex<double>) > fileSize) {
+                mFailure = true;
                 throw InvalidFileFormat();
             }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWire;
-            newNode->GetWires().push_back(newWire);
+            std::shared_ptr<std::complex<double>> vals;
+            if (numVals > 0) {
+                vals = std::shared_ptr<std::complex<double>>(mapping, reinterpret_cast<std::complex<double> *>(
+                        mapping.get() + payloadStart) + offset);
+            }
 
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
-            mNodesByWire[tempQubitValOne].push_back(newNode);
+            nodes[i] = std::make_shared<Node>(rank, vals, numVals);
+            nodes[i]->SetTypeOfNode(type);
+            nodes[i]->SetTypeOfNodeString(typeString);
+            nodes[i]->mID = id;
+            nodes[i]->mIndexOfPreviousNode = indexOfPreviousNode;
+            nodes[i]->mCreatedFrom = createdFrom;
+            nodes[i]->mContracted = contracted;
+            nodes[i]->mSelectedInCostContractionAlgorithm = selected;
+            nodes[i]->mParameterSlot = parameterSlot;
+            nodes[i]->mParameterScale = parameterScale;
+            for (int wireNumber: wireNumbers) {
+                nodes[i]->AddWireNumber(wireNumber);
+            }
         }
-        else if (parsedLine[0] == "H") //if the line is an H gate
-        {
-            //see Rx gate
-            //std::cout<<"Created H Node..."<<std::endl;
-            newNode = std::make_shared<HNode>();
-            int tempQubitValOne{std::stoi(parsedLine[1])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
+        auto nodeAt = [&nodes, this](long long index) -> std::shared_ptr<Node> {
+            if (index >= static_cast<long long>(nodes.size())) {
+                mFailure = true;
                 throw InvalidFileFormat();
             }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWire;
-            newNode->GetWires().push_back(newWire);
+            return index < 0 ? nullptr : nodes[index];
+        };
 
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-        } else if (parsedLine[0] == "X") //if the line is an X gate
-        {
-            //see Rx gate
-            //std::cout<<"Created X Node..."<<std::endl;
-            newNode = std::make_shared<XNode>();
-            int tempQubitValOne{std::stoi(parsedLine[1])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
-                throw InvalidFileFormat();
+        //rebuild the wires and attach them to the nodes in their original order
+        std::vector<std::shared_ptr<Wire>> wires(wireRecords.size());
+        for (int i = 0; i < wires.size(); i++) {
+            wires[i] = std::make_shared<Wire>(nodeAt(wireRecords[i].nodeA), nodeAt(wireRecords[i].nodeB),
+                                              wireRecords[i].qubit);
+            wires[i]->SetWireID(wireRecords[i].wireID);
+            wires[i]->SetIsContracted(wireRecords[i].contracted);
+        }
+        for (int i = 0; i < nodes.size(); i++) {
+            for (long long wire: nodeWires[i]) {
+                nodes[i]->GetWires().push_back(wires[wire]);
             }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWire;
-            newNode->GetWires().push_back(newWire);
+        }
 
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-        } else if (parsedLine[0] == "Y") //if the line is a Y gate
-        {
-            //see Rx gate
-            //std::cout<<"Created Y Node..."<<std::endl;
-            newNode = std::make_shared<YNode>();
-            int tempQubitValOne{std::stoi(parsedLine[1])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
-                throw InvalidFileFormat();
+        mAllNodes.assign(nodes.begin(), nodes.begin() + std::min<long long>(numAllNodes, nodes.size()));
+        mUncontractedNodes.resize(getInt());
+        for (auto &tempNode: mUncontractedNodes) {
+            tempNode = nodeAt(getInt());
+        }
+        mNodesByWire.resize(getInt());
+        for (auto &tempVect: mNodesByWire) {
+            tempVect.resize(getInt());
+            for (auto &tempNode: tempVect) {
+                tempNode = nodeAt(getInt());
             }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWire;
-            newNode->GetWires().push_back(newWire);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-        } else if (parsedLine[0] == "Z") //if the line is a Z gate
-        {
-            //see Rx gate
-            //std::cout<<"Created Z Node..."<<std::endl;
-            newNode = std::make_shared<ZNode>();
-            int tempQubitValOne{std::stoi(parsedLine[1])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
-                throw InvalidFileFormat();
+        }
+        mQubitLines.resize(getInt());
+        for (int &line: mQubitLines) {
+            line = getInt();
+        }
+        mParameterizedNodes.resize(getInt());
+        for (auto &tempNode: mParameterizedNodes) {
+            tempNode = nodeAt(getInt());
+        }
+        mParameters.resize(getInt());
+        for (double &parameter: mParameters) {
+            parameter = getDouble();
+        }
+        for (auto *gates: {&mArbitraryOneQubitGates, &mArbitraryTwoQubitGates}) {
+            long long numGates(getInt());
+            for (long long i = 0; i < numGates; i++) {
+                std::string name(getString());
+                gates->insert({name, getString()});
             }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWire;
-            newNode->GetWires().push_back(newWire);
+        }
+    }
 
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-        } else if (parsedLine[0] == "CNOT") //if the line is a CNOT gate
-        {
 
-            //std::cout<<"Created CNOT Node..."<<std::endl;
-            newNode = std::make_shared<CNOTNode>();
-            int tempQubitValOne{std::stoi(parsedLine[1])}; //qubit val one is control, and qubit val 2 is target
-            int tempQubitValTwo{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1 || tempQubitValTwo > mNumberOfQubits - 1 ||
-                tempQubitValOne == tempQubitValTwo) {
-                throw InvalidFileFormat();
-            }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValTwo]);
-            mNetworkParsingWires[tempQubitValTwo]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWireOne = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWireOne;
-            newNode->GetWires().push_back(newWireOne);
-            std::shared_ptr<Wire> newWireTwo = std::make_shared<Wire>(newNode, nullptr, tempQubitValTwo);
-            mNetworkParsingWires[tempQubitValTwo] = newWireTwo;
-            newNode->GetWires().push_back(newWireTwo);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->AddWireNumber(tempQubitValTwo);
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-            mNodesByWire[tempQubitValTwo].push_back(newNode);
-        } else if (parsedLine[0] == "SWAP") //if the line is a SWAP gate
-        {
-            //std::cout<<"Created SWAP Node..."<<std::endl;
-            newNode = std::make_shared<SwapNode>();
-            int tempQubitValOne{std::stoi(parsedLine[1])};
-            int tempQubitValTwo{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1 || tempQubitValTwo > mNumberOfQubits - 1 ||
-                tempQubitValOne == tempQubitValTwo) {
-                throw InvalidFileFormat();
-            }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValTwo]);
-            mNetworkParsingWires[tempQubitValTwo]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWireOne = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWireOne;
-            newNode->GetWires().push_back(newWireOne);
-            std::shared_ptr<Wire> newWireTwo = std::make_shared<Wire>(newNode, nullptr, tempQubitValTwo);
-            mNetworkParsingWires[tempQubitValTwo] = newWireTwo;
-            newNode->GetWires().push_back(newWireTwo);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->AddWireNumber(tempQubitValTwo);
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-            mNodesByWire[tempQubitValTwo].push_back(newNode);
-        } else if (parsedLine[0] == "CRk") //if the line is a controlled Rk gate
-        {
-            //std::cout<<"Created CRk Node..."<<std::endl;
-            int tempQubitValOne{std::stoi(parsedLine[1])}; //qubit val one is control, and qubit val 2 is target
-            int tempQubitValTwo{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1 || tempQubitValTwo > mNumberOfQubits - 1 ||
-                tempQubitValOne == tempQubitValTwo) {
-                throw InvalidFileFormat();
-            }
-            newNode = std::make_shared<CRkNode>(tempQubitValOne);
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValTwo]);
-            mNetworkParsingWires[tempQubitValTwo]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWireOne = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWireOne;
-            newNode->GetWires().push_back(newWireOne);
-            std::shared_ptr<Wire> newWireTwo = std::make_shared<Wire>(newNode, nullptr, tempQubitValTwo);
-            mNetworkParsingWires[tempQubitValTwo] = newWireTwo;
-            newNode->GetWires().push_back(newWireTwo);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->AddWireNumber(tempQubitValTwo);
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-            mNodesByWire[tempQubitValTwo].push_back(newNode);
-        } else if (parsedLine[0] == "CZ") //if the line is a controlled Z gate
-        {
-            //std::cout<<"Created CZ Node..."<<std::endl;
-            int tempQubitValOne{std::stoi(parsedLine[1])}; //qubit val one is control, and qubit val 2 is target
-            int tempQubitValTwo{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1 || tempQubitValTwo > mNumberOfQubits - 1 ||
-                tempQubitValOne == tempQubitValTwo) {
-                throw InvalidFileFormat();
-            }
-            newNode = std::make_shared<CZNode>();
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValTwo]);
-            mNetworkParsingWires[tempQubitValTwo]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWireOne = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWireOne;
-            newNode->GetWires().push_back(newWireOne);
-            std::shared_ptr<Wire> newWireTwo = std::make_shared<Wire>(newNode, nullptr, tempQubitValTwo);
-            mNetworkParsingWires[tempQubitValTwo] = newWireTwo;
-            newNode->GetWires().push_back(newWireTwo);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->AddWireNumber(tempQubitValTwo);
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-            mNodesByWire[tempQubitValTwo].push_back(newNode);
-        } else if (parsedLine[0] == "CPHASE") //if the line is a controlled phase gate
-        {
-            //std::cout<<"Created CPHASE Node..."<<std::endl;
-            double tempPhaseVal{std::stod(parsedLine[1])};
-            int tempQubitValOne{std::stoi(parsedLine[2])}; //qubit val one is control, and qubit val 2 is target
-            int tempQubitValTwo{std::stoi(parsedLine[3])};
-            if (tempQubitValOne > mNumberOfQubits - 1 || tempQubitValTwo > mNumberOfQubits - 1 ||
-                tempQubitValOne == tempQubitValTwo) {
-                throw InvalidFileFormat();
+//this function contracts the tensor network in the order of creation of nodes - use this only to test. Otherwise, use the
+//functions in the parallelizer wrapper class
+    void Network::ContractNetworkLinearly() {
+        std::shared_ptr<Node> temp;
+        while (!mDone) {
+            if(!mUncontractedNodes[0]->GetWires()[0]->GetNodeA().expired() && !mUncontractedNodes[0]->GetWires()[0]->GetNodeB().expired())
+            {
+                std::shared_ptr<Node> tempA(mUncontractedNodes[0]->GetWires()[0]->GetNodeA().lock());
+                std::shared_ptr<Node> tempB(mUncontractedNodes[0]->GetWires()[0]->GetNodeB().lock());
+                ContractNodes(tempA, tempB, 1000);
+            } else
+            {
+                throw InvalidContractionMethod();
             }
-            newNode = std::make_shared<CPhaseNode>(tempPhaseVal);
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValTwo]);
-            mNetworkParsingWires[tempQubitValTwo]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWireOne = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWireOne;
-            newNode->GetWires().push_back(newWireOne);
-            std::shared_ptr<Wire> newWireTwo = std::make_shared<Wire>(newNode, nullptr, tempQubitValTwo);
-            mNetworkParsingWires[tempQubitValTwo] = newWireTwo;
-            newNode->GetWires().push_back(newWireTwo);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->AddWireNumber(tempQubitValTwo);
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-            mNodesByWire[tempQubitValTwo].push_back(newNode);
-        } else if (parsedLine[0] == "def1") //if the line defines an arbitrary one qubit gate
+        }
+    }
+
+
+//this function takes in a line from the qasm file and parses it, creating the appropriate node or arbitrary gate definition
+    void Network::ParseNode(std::string &inputLine) {
+        // std::cout<<"Attempting To Parse A Node"<<std::endl;
+        std::vector<std::string> parsedLine;
+        //parse the line into tokens (with a space as the delimiter
+        ParseTokens(inputLine, parsedLine);
+
+        if (parsedLine.size() == 0) {
+            return;
+        }
+
+        if (parsedLine[0] == "def1") //if the line defines an arbitrary one qubit gate
         {
             //add the name of the gate and the file path to the matrix values to a map
             mArbitraryOneQubitGates.insert({parsedLine[1], parsedLine[2]});
@@ -645,53 +1007,22 @@ namespace qtorch {
             //add the name of the gate and the file path to the matrix values to a map
             mArbitraryTwoQubitGates.insert({parsedLine[1], parsedLine[2]});
             return;
-        } else if (mArbitraryOneQubitGates.find(parsedLine[0]) !=
-                   mArbitraryOneQubitGates.end()) //if the line is an arbitrary one qubit gate
-        {
-            newNode = std::make_shared<ArbitraryOneQubitNode>(mArbitraryOneQubitGates[parsedLine[0]], parsedLine[0]);
-            //std::cout<<"Created "<<parsedLine[0]<<" Node..."<<std::endl;
-            int tempQubitValOne{std::stoi(parsedLine[1])};
-            if (tempQubitValOne > mNumberOfQubits - 1) {
-                throw InvalidFileFormat();
-            }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWire;
-            newNode->GetWires().push_back(newWire);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->mIndexOfPreviousNode = mNodesByWire[tempQubitValOne].size() - 1;
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-        } else if (mArbitraryTwoQubitGates.find(parsedLine[0]) !=
-                   mArbitraryTwoQubitGates.end()) //if the line is an arbitrary two qubit gate
+        }
+
+        //Rx 3.1415 0 = Rx(pi) on qubit 0
+        //Rx 2*$0 0 = Rx(2 * parameter 0) on qubit 0
+        //CNOT 0 1 = CNOT with control qubit 0 and target qubit 1
+        //CPHASE 3.1415 0 1 = controlled phase(pi) with control qubit 0 and target qubit 1
+        //RZZ 3.1415 0 1 = exp(-i pi/2 Z Z) on qubits 0 and 1
+        Gate gate(parsedLine[0], {});
+        int numGateQubits(GetGateNumQubits(gate));
+        int firstQubitToken(1);
+        if (gate.name == "Rx" || gate.name == "RX" || gate.name == "Ry" || gate.name == "RY" || gate.name == "Rz" ||
+            gate.name == "RZ" || gate.name == "PHASE" || gate.name == "CPHASE" || gate.name == "RZZ") //the angle comes before the qubits
         {
-            // std::cout<<"Created "<<parsedLine[0]<<" Node..."<<std::endl;
-            newNode = std::make_shared<ArbitraryTwoQubitNode>(mArbitraryTwoQubitGates[parsedLine[0]], parsedLine[0]);
-            int tempQubitValOne{std::stoi(parsedLine[1])};
-            int tempQubitValTwo{std::stoi(parsedLine[2])};
-            if (tempQubitValOne > mNumberOfQubits - 1 || tempQubitValTwo > mNumberOfQubits - 1 ||
-                tempQubitValOne == tempQubitValTwo) {
-                throw InvalidFileFormat();
-            }
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValOne]);
-            mNetworkParsingWires[tempQubitValOne]->SetNodeB(newNode);
-            newNode->GetWires().push_back(mNetworkParsingWires[tempQubitValTwo]);
-            mNetworkParsingWires[tempQubitValTwo]->SetNodeB(newNode);
-            std::shared_ptr<Wire> newWireOne = std::make_shared<Wire>(newNode, nullptr, tempQubitValOne);
-            mNetworkParsingWires[tempQubitValOne] = newWireOne;
-            newNode->GetWires().push_back(newWireOne);
-            std::shared_ptr<Wire> newWireTwo = std::make_shared<Wire>(newNode, nullptr, tempQubitValTwo);
-            mNetworkParsingWires[tempQubitValTwo] = newWireTwo;
-            newNode->GetWires().push_back(newWireTwo);
-
-            newNode->AddWireNumber(tempQubitValOne);
-            newNode->AddWireNumber(tempQubitValTwo);
-            mNodesByWire[tempQubitValOne].push_back(newNode);
-            mNodesByWire[tempQubitValTwo].push_back(newNode);
-        }
-            // add more node functionality here --> kraus op gate,
-        else //if the does not define any recognized command
+            firstQubitToken = 2;
+        }
+        if (numGateQubits == 0 || parsedLine.size() < firstQubitToken + numGateQubits) //if the line does not define any recognized command
         {
             std::cout << "Failed to compile line: " << std::endl;
             for (const auto &t: parsedLine) {
@@ -700,12 +1031,270 @@ namespace qtorch {
             std::cout << std::endl;
             throw InvalidFileFormat();
         }
+        if (firstQubitToken == 2) {
+            ParseAngle(parsedLine[1], gate);
+        }
+        for (int i(firstQubitToken); i < firstQubitToken + numGateQubits; ++i) {
+            gate.qubits.push_back(std::stoi(parsedLine[i]));
+        }
+        AddGate(gate);
+    }
+
+//this function returns the number of qubits a gate acts on, or 0 if the gate is not recognized
+    const int Network::GetGateNumQubits(const Gate &gate) const {
+        if (gate.matrix.size() == 4) {
+            return 1;
+        } else if (gate.matrix.size() == 16) {
+            return 2;
+        } else if (!gate.matrix.empty()) {
+            return 0;
+        }
+        static const std::unordered_map<std::string, int> builtInGates{{"Rx",     1},
+                                                                        {"RX",     1},
+                                                                        {"Ry",     1},
+                                                                        {"RY",     1},
+                                                                        {"Rz",     1},
+                                                                        {"RZ",     1},
+                                                                        {"PHASE",  1},
+                                                                        {"H",      1},
+                                                                        {"X",      1},
+                                                                        {"Y",      1},
+                                                                        {"Z",      1},
+                                                                        {"CNOT",   2},
+                                                                        {"SWAP",   2},
+                                                                        {"CRk",    2},
+                                                                        {"CZ",     2},
+                                                                        {"CPHASE", 2},
+                                                                        {"RZZ",    2}};
+        auto builtIn = builtInGates.find(gate.name);
+        if (builtIn != builtInGates.end()) {
+            return builtIn->second;
+        } else if (mArbitraryOneQubitGates.find(gate.name) != mArbitraryOneQubitGates.end()) {
+            return 1;
+        } else if (mArbitraryTwoQubitGates.find(gate.name) != mArbitraryTwoQubitGates.end()) {
+            return 2;
+        }
+        return 0;
+    }
+
+//this function creates the node for a gate, connects it to the hanging wires of its qubits and adds it to the network.
+//It is shared by the qasm parser and circuits built in memory
+    void Network::AddGate(const Gate &gate) {
+        int numGateQubits(GetGateNumQubits(gate));
+        if (numGateQubits == 0 || gate.qubits.size() != numGateQubits) {
+            std::cout << "Failed to add gate: " << gate.name << std::endl;
+            throw InvalidFileFormat();
+        }
+        for (const int qubit: gate.qubits) {
+            if (qubit < 0 || qubit > mNumberOfQubits - 1) {
+                throw InvalidFileFormat();
+            }
+        }
+        if (numGateQubits == 2 && gate.qubits[0] == gate.qubits[1]) {
+            throw InvalidFileFormat();
+        }
+
+        //a SWAP only exchanges which line carries each qubit, so it needs no node
+        if (gate.name == "SWAP" && gate.matrix.empty()) {
+            std::swap(mQubitLines[gate.qubits[0]], mQubitLines[gate.qubits[1]]);
+            return;
+        }
+
+        std::shared_ptr<Node> newNode;
+        bool hasAngle(false);
+        if (!gate.matrix.empty()) //if the gate is an arbitrary unitary given in memory
+        {
+            if (numGateQubits == 1) {
+                newNode = std::make_shared<ArbitraryOneQubitNode>(gate.matrix, gate.name);
+            } else {
+                newNode = std::make_shared<ArbitraryTwoQubitNode>(gate.matrix, gate.name);
+            }
+        } else if (gate.name == "Rx" || gate.name == "RX") {
+            newNode = std::make_shared<RxNode>(0.0);
+            hasAngle = true;
+        } else if (gate.name == "Ry" || gate.name == "RY") {
+            newNode = std::make_shared<RyNode>(0.0);
+            hasAngle = true;
+        } else if (gate.name == "Rz" || gate.name == "RZ") {
+            newNode = std::make_shared<RzNode>(0.0);
+            hasAngle = true;
+        } else if (gate.name == "PHASE") {
+            newNode = std::make_shared<PhaseNode>(0.0);
+            hasAngle = true;
+        } else if (gate.name == "H") {
+            newNode = std::make_shared<HNode>();
+        } else if (gate.name == "X") {
+            newNode = std::make_shared<XNode>();
+        } else if (gate.name == "Y") {
+            newNode = std::make_shared<YNode>();
+        } else if (gate.name == "Z") {
+            newNode = std::make_shared<ZNode>();
+        } else if (gate.name == "CNOT") //qubit one is control, and qubit two is target
+        {
+            newNode = std::make_shared<CNOTNode>();
+        } else if (gate.name == "SWAP") {
+            newNode = std::make_shared<SwapNode>();
+        } else if (gate.name == "CRk") {
+            newNode = std::make_shared<CRkNode>(gate.qubits[0]);
+        } else if (gate.name == "CZ") {
+            newNode = std::make_shared<CZNode>();
+        } else if (gate.name == "CPHASE") {
+            newNode = std::make_shared<CPhaseNode>(0.0);
+            hasAngle = true;
+        } else if (gate.name == "RZZ") {
+            newNode = std::make_shared<RzzNode>(0.0);
+            hasAngle = true;
+        } else //if the gate is an arbitrary gate defined in the qasm file - its matrix file is only read once per network
+        {
+            auto tensor = mArbitraryGateTensors.find(gate.name);
+            if (tensor != mArbitraryGateTensors.end() && numGateQubits == 1) {
+                newNode = std::make_shared<ArbitraryOneQubitNode>(tensor->second, gate.name);
+            } else if (tensor != mArbitraryGateTensors.end()) {
+                newNode = std::make_shared<ArbitraryTwoQubitNode>(tensor->second, gate.name);
+            } else if (numGateQubits == 1) {
+                newNode = std::make_shared<ArbitraryOneQubitNode>(mArbitraryOneQubitGates[gate.name], gate.name);
+            } else {
+                newNode = std::make_shared<ArbitraryTwoQubitNode>(mArbitraryTwoQubitGates[gate.name], gate.name);
+            }
+            mArbitraryGateTensors[gate.name] = newNode->GetSharedTensorVals();
+        }
+        // add more node functionality here --> kraus op gate,
+
+        //set the phase, which is either fixed or taken from a parameter slot (0 if no parameters have been bound yet)
+        if (hasAngle) {
+            double angle(gate.angle);
+            if (gate.parameterSlot >= 0) {
+                AddParameterizedNode(newNode, gate.parameterSlot, gate.parameterScale);
+                angle = gate.parameterSlot < mParameters.size() ? gate.parameterScale * mParameters[gate.parameterSlot]
+                                                                : 0.0;
+            }
+            newNode->SetAngle(angle);
+        }
+
+        if (numGateQubits == 1) {
+            AttachOneQubitNode(newNode, mQubitLines[gate.qubits[0]]);
+        } else {
+            AttachTwoQubitNode(newNode, mQubitLines[gate.qubits[0]], mQubitLines[gate.qubits[1]]);
+        }
 
         //add the node to mAllNodes and give it an ID number
         mAllNodes.push_back(newNode);
         newNode->mID = mAllNodes.size() - 1;
     }
 
+//this function connects a one qubit gate node to the current hanging wire of the line carrying its qubit (see mQubitLines)
+//and gives it a new hanging wire
+    void Network::AttachOneQubitNode(std::shared_ptr<Node> &newNode, const int line) {
+        //add the current hanging wire to the node
+        newNode->GetWires().push_back(mNetworkParsingWires[line]);
+
+        //add the node to the current hanging wire
+        mNetworkParsingWires[line]->SetNodeB(newNode);
+
+        //create a new hanging wire
+        std::shared_ptr<Wire> newWire = std::make_shared<Wire>(newNode, nullptr, line);
+
+        //set the current hanging wire to the new wire
+        mNetworkParsingWires[line] = newWire;
+
+        //add the hanging wire to the new node
+        newNode->GetWires().push_back(newWire);
+
+        //add the wire number to the new node
+        newNode->AddWireNumber(line);
+
+        //set the index of the previous node
+        newNode->mIndexOfPreviousNode = mNodesByWire[line].size() - 1;
+
+        //add the node to mNodes by wire
+        mNodesByWire[line].push_back(newNode);
+    }
+
+//this function connects a two qubit gate node to the current hanging wires of the lines of both its qubits (see
+//AttachOneQubitNode)
+    void Network::AttachTwoQubitNode(std::shared_ptr<Node> &newNode, const int lineOne, const int lineTwo) {
+        newNode->GetWires().push_back(mNetworkParsingWires[lineOne]);
+        mNetworkParsingWires[lineOne]->SetNodeB(newNode);
+        newNode->GetWires().push_back(mNetworkParsingWires[lineTwo]);
+        mNetworkParsingWires[lineTwo]->SetNodeB(newNode);
+        std::shared_ptr<Wire> newWireOne = std::make_shared<Wire>(newNode, nullptr, lineOne);
+        mNetworkParsingWires[lineOne] = newWireOne;
+        newNode->GetWires().push_back(newWireOne);
+        std::shared_ptr<Wire> newWireTwo = std::make_shared<Wire>(newNode, nullptr, lineTwo);
+        mNetworkParsingWires[lineTwo] = newWireTwo;
+        newNode->GetWires().push_back(newWireTwo);
+
+        newNode->AddWireNumber(lineOne);
+        newNode->AddWireNumber(lineTwo);
+        mNodesByWire[lineOne].push_back(newNode);
+        mNodesByWire[lineTwo].push_back(newNode);
+    }
+
+
+//this function takes in the angle token of a rotation/phase gate and sets the angle of the gate. The token is either a
+//number or a reference to a parameter slot: $k, -$k or scale*$k (e.g. "2*$0" is twice parameter 0). A parameterized gate
+//takes its angle from the bound parameters and can be updated later by BindParameters (see AddGate)
+    void Network::ParseAngle(const std::string &token, Gate &gate) {
+        std::size_t slotPosition = token.find('$');
+        if (slotPosition == std::string::npos) {
+            gate.angle = std::stod(token);
+            return;
+        }
+        double scale(1.0);
+        std::string scaleToken(token.substr(0, slotPosition));
+        if (scaleToken == "-") {
+            scale = -1.0;
+        } else if (!scaleToken.empty()) {
+            if (scaleToken.back() != '*') {
+                throw InvalidFileFormat();
+            }
+            scale = std::stod(scaleToken.substr(0, scaleToken.size() - 1));
+        }
+        int slot{std::stoi(token.substr(slotPosition + 1))};
+        if (slot < 0) {
+            throw InvalidFileFormat();
+        }
+        gate.parameterSlot = slot;
+        gate.parameterScale = scale;
+    }
+
+//this function records a gate whose angle is bound to a parameter slot
+    void Network::AddParameterizedNode(std::shared_ptr<Node> &newNode, int slot, double scale) {
+        newNode->mParameterSlot = slot;
+        newNode->mParameterScale = scale;
+        mParameterizedNodes.push_back(newNode);
+    }
+
+/*This function binds new values to the parameter slots of the circuit, changing the angles of only the gates that refer
+ * to a parameter (their tensors are looked up again when they are next read). parameters[k] is the value of slot k. The
+ * values are kept, so Reset() reparses the circuit with the same binding. Gates that have already been contracted can't be
+ * rebound - bind before contracting, or bind a template network and contract clones of it (see Clone); clones made earlier
+ * keep the values they were made with
+ */
+    void Network::BindParameters(const std::vector<double> &parameters) {
+        if (parameters.size() < GetNumParameters()) {
+            throw InvalidFunctionInput();
+        }
+        for (auto &tempNode: mParameterizedNodes) {
+            if (tempNode->mContracted) {
+                throw InvalidFunctionInput();
+            }
+        }
+        for (auto &tempNode: mParameterizedNodes) {
+            tempNode->SetAngle(tempNode->mParameterScale * parameters[tempNode->mParameterSlot]);
+        }
+        mParameters = parameters;
+    }
+
+//returns the number of parameter slots the circuit refers to (one more than the highest slot used)
+    const int Network::GetNumParameters() const noexcept {
+        int numParameters(0);
+        for (const auto &tempNode: mParameterizedNodes) {
+            numParameters = std::max(numParameters, tempNode->mParameterSlot + 1);
+        }
+        return numParameters;
+    }
+
 
 //this function takes in pointers to two nodes and a threshold value and contracts them under certain conditions:
 //1. the two nodes are connected
@@ -768,8 +1357,15 @@ namespace qtorch {
             ++j;
         }
 
+        //nodes that share no wires are only contracted (as an outer product) when all their wires are open - see OpenQubit
+        auto hasOnlyOpenWires = [](const std::shared_ptr<Node> &node) {
+            return std::all_of(node->GetWires().begin(), node->GetWires().end(), [](const std::shared_ptr<Wire> &wire) {
+                return wire->GetNodeA().expired() || wire->GetNodeB().expired();
+            });
+        };
+
         //if there are no connected wires or if the rank of resulting node > max(rankA, rankB) + threshold, return nullptr
-        if ((indicesA.size() == 0 && indicesC.size() > 0) || remainingWires.size() > std::max(nodeA->mRank, nodeB->mRank) + threshold ||
+        if ((indicesA.size() == 0 && indicesC.size() > 0 && !(hasOnlyOpenWires(nodeA) && hasOnlyOpenWires(nodeB))) || remainingWires.size() > std::max(nodeA->mRank, nodeB->mRank) + threshold ||
             nodeA->mContracted || nodeB->mContracted) {
             //if no nodes are shared
             mLocker.unlock();
@@ -889,9 +1485,17 @@ namespace qtorch {
         //if rank of A or B is > 9, parallelize inner loop
         int toContractOn((vectorIndexA.size() + vectorIndexB.size() - toNotSumOn.size()) / 2);
 
-        auto f1 = [&toNotSumOn, &toSumOn, &toContractOn](
+        //actually do the threading: using the lambda below
+        if (nodeA->GetNumTensorVals() == 0 || nodeB->GetNumTensorVals() == 0) {
+            throw InvalidFunctionInput();
+        }
+        //fetch the raw values once - nodeC is freshly created, so it never needs to be copied on write
+        const std::complex<double> *valsA = nodeA->GetTensorData();
+        const std::complex<double> *valsB = nodeB->GetTensorData();
+        std::complex<double> *valsC = nodeC->GetWritableTensorData();
+
+        auto f1 = [&toNotSumOn, &toSumOn, &toContractOn, valsA, valsB, valsC](
                 int indexASize, int indexBSize,
-                std::shared_ptr<Node> nodeA, std::shared_ptr<Node> nodeB, std::shared_ptr<Node> nodeC,
                 unsigned long long maxCount,
                 unsigned long long minCount) {
             std::vector<int> vectorIndexA(indexASize);
@@ -928,26 +1532,30 @@ namespace qtorch {
                         sum2 += t << (2 * multiplier2);
                         ++multiplier2;
                     });
-                    nodeC->Index(Ccounter) += nodeA->Access(sum) * nodeB->Access(sum2);
+                    valsC[Ccounter] += valsA[sum] * valsB[sum2];
                     //perform the math
                 }
             }
         };
 
-        //actually do the threading: using the lambda above
-        if (nodeA->GetTensorVals().size() == 0 || nodeB->GetTensorVals().size() == 0) {
-            throw InvalidFunctionInput();
-        }
-        if (nodeC->mRank >= THRESH_RANK_THREAD) {
+        if (ContractBoundaryNode(toNotSumOn, toSumOn, nodeA, nodeB, valsA, valsB, valsC)) {
+            //the initial state, measurement or trace sliced (or summed two slices of) the other node
+        } else if (ContractDiagonalNode(toNotSumOn, toSumOn, nodeA, nodeB, valsA, valsB, valsC)) {
+            //the diagonal gate only scaled the values of the other node
+        } else if (ContractPermutationNode(toNotSumOn, toSumOn, nodeA, nodeB, valsA, valsB, valsC)) {
+            //the permutation gate only moved the values of the other node
+        } else if (ContractSparseNodes(toNotSumOn, toSumOn, nodeA, nodeB, valsA, valsB, valsC)) {
+            //only the products of nonzero values were added up
+        } else if (nodeC->mRank >= THRESH_RANK_THREAD) {
             std::vector<std::thread> threads(mNumberOfThreads - 1);
             for (int i = 0; i < mNumberOfThreads; i++) {
                 if (i != (mNumberOfThreads - 1)) {
-                    threads[i] = std::thread(f1, vectorIndexA.size(), vectorIndexB.size(), nodeA, nodeB, nodeC,
+                    threads[i] = std::thread(f1, vectorIndexA.size(), vectorIndexB.size(),
                                              (i + 1) *
                                              static_cast<long long>(pow(4, toNotSumOn.size()) / mNumberOfThreads),
                                              i * static_cast<long long>(pow(4, toNotSumOn.size()) / mNumberOfThreads));
                 } else {
-                    f1(vectorIndexA.size(), vectorIndexB.size(), nodeA, nodeB, nodeC,
+                    f1(vectorIndexA.size(), vectorIndexB.size(),
                        static_cast<long long>(pow(4, toNotSumOn.size())),
                        i * static_cast<long long>(pow(4, toNotSumOn.size()) / mNumberOfThreads));
                 }
@@ -956,20 +1564,380 @@ namespace qtorch {
                 tem.join();
             }
         } else {
-            f1(vectorIndexA.size(), vectorIndexB.size(), nodeA, nodeB, nodeC, pow(4, toNotSumOn.size()), 0);
+            f1(vectorIndexA.size(), vectorIndexB.size(), pow(4, toNotSumOn.size()), 0);
         }
         if (toNotSumOn.size() == 0) {
             //if you're contracting two nodes to get a rank 0 tensor
             if (std::abs(mFinalVal.real()) <= 1.0e-30 && std::abs(mFinalVal.imag()) <= 1.0e-30 || (nodeA->mRank == 0 && nodeB->mRank == 0)){
                 mFinalVal = nodeC->Access({0});
             }
-            if (mUncontractedNodes.size() == 2){
-                mDone = true;
+        }
+        //the last two nodes are contracted - with open qubits the result keeps their wires
+        if (mUncontractedNodes.size() == 2){
+            mDone = true;
+        }
+
+    }
+
+
+/*This function contracts a diagonal two qubit gate (see Node::mDiagonal) with a node joined to it by at most one wire of
+ * each of its qubits, the common case of a gate contracted into the rest of its circuit. Each value of the result is then
+ * a single value of the other node scaled by the gate's phase (or zero), instead of a sum of products. Returns false (and
+ * does nothing) if neither node is such a gate. The arguments are those of ContractIndices
+ */
+    bool Network::ContractDiagonalNode(const std::vector<std::pair<bool, int>> &toNotSumOn,
+                                       const std::vector<std::pair<int, int>> &toSumOn,
+                                       const std::shared_ptr<Node> &nodeA, const std::shared_ptr<Node> &nodeB,
+                                       const std::complex<double> *valsA, const std::complex<double> *valsB,
+                                       std::complex<double> *valsC) const {
+        bool diagonalIsA(nodeA->mDiagonal && nodeA->mRank == 4);
+        if (!diagonalIsA && !(nodeB->mDiagonal && nodeB->mRank == 4)) {
+            return false;
+        }
+        if (toSumOn.empty() || toSumOn.size() > 2) {
+            return false;
+        }
+        const std::shared_ptr<Node> &other = diagonalIsA ? nodeB : nodeA;
+        const std::complex<double> *diagonalVals = diagonalIsA ? valsA : valsB;
+        const std::complex<double> *otherVals = diagonalIsA ? valsB : valsA;
+
+        //the index of C each index of the diagonal gate and of the other node reads its digit from
+        std::vector<int> diagonalPositions(4, -1);
+        std::vector<int> otherPositions(other->mRank, -1);
+        for (int i(0); i < toNotSumOn.size(); ++i) {
+            if (toNotSumOn[i].first == diagonalIsA) {
+                diagonalPositions[toNotSumOn[i].second] = i;
+            } else {
+                otherPositions[toNotSumOn[i].second] = i;
+            }
+        }
+        //each joined wire must leave the other wire of its qubit in C - the joined index then takes the same digit
+        for (const auto &pair: toSumOn) {
+            int diagonalIndex(diagonalIsA ? pair.first : pair.second);
+            int otherIndex(diagonalIsA ? pair.second : pair.first);
+            int partnerPosition(diagonalPositions[(diagonalIndex + 2) % 4]);
+            if (partnerPosition == -1) {
+                return false;
+            }
+            otherPositions[otherIndex] = partnerPosition;
+        }
+        unsigned long long sizeC(1ULL << (2 * toNotSumOn.size()));
+        for (unsigned long long Ccounter(0); Ccounter < sizeC; ++Ccounter) {
+            if (Ccounter % TIME_CHECK_INTERVAL == 0 && totTimer.getElapsed() >= maxTime) {
+                break;
+            }
+            //a qubit with both of its indices in C only has values where they are equal
+            int digits[4];
+            for (int j(0); j < 4; ++j) {
+                digits[j] = diagonalPositions[j] == -1 ? -1 : (Ccounter >> (2 * diagonalPositions[j])) % 4;
+            }
+            if ((digits[0] != -1 && digits[2] != -1 && digits[0] != digits[2]) ||
+                (digits[1] != -1 && digits[3] != -1 && digits[1] != digits[3])) {
+                valsC[Ccounter] = 0.0;
+                continue;
+            }
+            unsigned long long otherIndex(0);
+            for (int j(0); j < otherPositions.size(); ++j) {
+                otherIndex += ((Ccounter >> (2 * otherPositions[j])) % 4) << (2 * j);
+            }
+            int firstDigit(digits[0] != -1 ? digits[0] : digits[2]);
+            int secondDigit(digits[1] != -1 ? digits[1] : digits[3]);
+            valsC[Ccounter] = otherVals[otherIndex] * diagonalVals[firstDigit * 17 + secondDigit * 68];
+        }
+        return true;
+    }
+
+/*This function contracts a permutation gate (see Node::mPermutation, e.g. X or CNOT) with a node joined to it by at least
+ * one wire. Every value of the result is gathered from the other node - the values it reads are found from the gate's
+ * nonzero entries once, and there are no multiplications. Returns false (and does nothing) if neither node is such a gate,
+ * or if one of the gate's values is not 1. The arguments are those of ContractIndices
+ */
+    bool Network::ContractPermutationNode(const std::vector<std::pair<bool, int>> &toNotSumOn,
+                                          const std::vector<std::pair<int, int>> &toSumOn,
+                                          const std::shared_ptr<Node> &nodeA, const std::shared_ptr<Node> &nodeB,
+                                          const std::complex<double> *valsA, const std::complex<double> *valsB,
+                                          std::complex<double> *valsC) const {
+        bool permutationIsA(nodeA->mPermutation);
+        if ((!permutationIsA && !nodeB->mPermutation) || toSumOn.empty()) {
+            return false;
+        }
+        const std::shared_ptr<Node> &permutation = permutationIsA ? nodeA : nodeB;
+        const std::complex<double> *permutationVals = permutationIsA ? valsA : valsB;
+        const std::complex<double> *otherVals = permutationIsA ? valsB : valsA;
+
+        //the indices of the gate that are kept (and where they are in C), and where each kept index of the other node is
+        std::vector<int> keptIndices;
+        std::vector<int> keptPositions;
+        std::vector<std::pair<int, int>> otherPositions; //(position in C, index in the other node)
+        for (int i(0); i < toNotSumOn.size(); ++i) {
+            if (toNotSumOn[i].first == permutationIsA) {
+                keptIndices.push_back(toNotSumOn[i].second);
+                keptPositions.push_back(i);
+            } else {
+                otherPositions.push_back({i, toNotSumOn[i].second});
+            }
+        }
+
+        //for each value of the gate's kept indices, the offsets in the other node of the entries the gate joins them to
+        std::vector<std::vector<unsigned long long>> gathers(1ULL << (2 * keptIndices.size()));
+        for (long long entry(0); entry < permutation->GetNumTensorVals(); ++entry) {
+            if (permutationVals[entry] == 0.0) {
+                continue;
+            }
+            if (permutationVals[entry] != 1.0) {
+                return false;
+            }
+            unsigned long long key(0);
+            for (int t(0); t < keptIndices.size(); ++t) {
+                key += ((entry >> (2 * keptIndices[t])) % 4) << (2 * t);
+            }
+            unsigned long long offset(0);
+            for (const auto &pair: toSumOn) {
+                int permutationIndex(permutationIsA ? pair.first : pair.second);
+                int otherIndex(permutationIsA ? pair.second : pair.first);
+                offset += ((entry >> (2 * permutationIndex)) % 4) << (2 * otherIndex);
+            }
+            gathers[key].push_back(offset);
+        }
+
+        unsigned long long sizeC(1ULL << (2 * toNotSumOn.size()));
+        for (unsigned long long Ccounter(0); Ccounter < sizeC; ++Ccounter) {
+            if (Ccounter % TIME_CHECK_INTERVAL == 0 && totTimer.getElapsed() >= maxTime) {
+                break;
+            }
+            unsigned long long key(0);
+            for (int t(0); t < keptPositions.size(); ++t) {
+                key += ((Ccounter >> (2 * keptPositions[t])) % 4) << (2 * t);
+            }
+            unsigned long long otherIndex(0);
+            for (const auto &position: otherPositions) {
+                otherIndex += ((Ccounter >> (2 * position.first)) % 4) << (2 * position.second);
+            }
+            std::complex<double> sum(0.0);
+            for (const unsigned long long offset: gathers[key]) {
+                sum += otherVals[otherIndex + offset];
+            }
+            valsC[Ccounter] = sum;
+        }
+        return true;
+    }
+
+/*This function contracts a rank 1 node (an initial state, a measurement or a trace) into the node on the other end of its
+ * wire. Such a node has at most two nonzero values, so the result is a slice of the other node at the index the boundary
+ * node selects, or the sum of two slices, copied in contiguous runs. Returns false (and does nothing) if neither node has
+ * rank 1. The arguments are those of ContractIndices
+ */
+    bool Network::ContractBoundaryNode(const std::vector<std::pair<bool, int>> &toNotSumOn,
+                                       const std::vector<std::pair<int, int>> &toSumOn,
+                                       const std::shared_ptr<Node> &nodeA, const std::shared_ptr<Node> &nodeB,
+                                       const std::complex<double> *valsA, const std::complex<double> *valsB,
+                                       std::complex<double> *valsC) const {
+        bool boundaryIsA(nodeA->mRank == 1);
+        if ((!boundaryIsA && nodeB->mRank != 1) || toSumOn.size() != 1) {
+            return false;
+        }
+        const std::shared_ptr<Node> &other = boundaryIsA ? nodeB : nodeA;
+        const std::complex<double> *boundaryVals = boundaryIsA ? valsA : valsB;
+        const std::complex<double> *otherVals = boundaryIsA ? valsB : valsA;
+        int joinedIndex(boundaryIsA ? toSumOn[0].second : toSumOn[0].first);
+
+        //the other indices of C must be those of the other node, in order
+        for (int i(0); i < toNotSumOn.size(); ++i) {
+            if (toNotSumOn[i].first == boundaryIsA || toNotSumOn[i].second != (i < joinedIndex ? i : i + 1)) {
+                return false;
             }
         }
 
+        //value d of the joined index is the slice at offset d * inner of every block of 4 * inner values
+        unsigned long long inner(1ULL << (2 * joinedIndex));
+        unsigned long long outer(1ULL << (2 * (other->mRank - 1 - joinedIndex)));
+        std::vector<std::pair<unsigned long long, std::complex<double>>> terms;
+        for (int d(0); d < 4; ++d) {
+            if (boundaryVals[d] != 0.0) {
+                terms.push_back({d * inner, boundaryVals[d]});
+            }
+        }
+        for (unsigned long long block(0); block < outer; ++block) {
+            //maxTime is checked about every TIME_CHECK_INTERVAL values, like in the other kernels
+            if ((inner * block) % TIME_CHECK_INTERVAL < inner && totTimer.getElapsed() >= maxTime) {
+                break;
+            }
+            const std::complex<double> *otherBlock = otherVals + 4 * inner * block;
+            std::complex<double> *blockC = valsC + inner * block;
+            if (terms.empty()) {
+                std::fill(blockC, blockC + inner, 0.0);
+            } else if (terms.size() == 1 && terms[0].second == 1.0) {
+                std::copy(otherBlock + terms[0].first, otherBlock + terms[0].first + inner, blockC);
+            } else {
+                for (unsigned long long j(0); j < inner; ++j) {
+                    std::complex<double> sum(0.0);
+                    for (const auto &term: terms) {
+                        sum += term.second * otherBlock[term.first + j];
+                    }
+                    blockC[j] = sum;
+                }
+            }
+        }
+        return true;
     }
 
+/*This function contracts two nodes by the nonzero values of the sparser one, if at most SPARSE_DENSITY_THRESHOLD of its
+ * values are nonzero (e.g. a sparse gate, or a node left with zeros by a projection). Each nonzero value is multiplied
+ * with the values of the other node it is joined to, and if the other node is sparse too, only with its nonzero values.
+ * The density is measured on every contraction, so a node that fills in goes back to the dense loop. A result of rank
+ * THRESH_RANK_THREAD or more is split between the threads of the network, like the dense loop. Returns false (and does
+ * nothing) if both nodes are too dense. The arguments are those of ContractIndices
+ */
+    bool Network::ContractSparseNodes(const std::vector<std::pair<bool, int>> &toNotSumOn,
+                                      const std::vector<std::pair<int, int>> &toSumOn,
+                                      const std::shared_ptr<Node> &nodeA, const std::shared_ptr<Node> &nodeB,
+                                      const std::complex<double> *valsA, const std::complex<double> *valsB,
+                                      std::complex<double> *valsC) const {
+        //the number of nonzero values, counted only until it passes SPARSE_DENSITY_THRESHOLD of the values (a dense node
+        //is then known to be dense without reading all of it)
+        auto countNonzeros = [](const std::complex<double> *vals, long long numVals) {
+            long long limit(static_cast<long long>(SPARSE_DENSITY_THRESHOLD * numVals)), count(0);
+            for (long long i(0); i < numVals && count <= limit; ++i) {
+                if (vals[i] != 0.0) {
+                    ++count;
+                }
+            }
+            return count;
+        };
+        auto nonzeros = [](const std::complex<double> *vals, long long numVals, long long count) {
+            std::vector<unsigned long long> entries;
+            entries.reserve(count);
+            for (long long i(0); i < numVals; ++i) {
+                if (vals[i] != 0.0) {
+                    entries.push_back(i);
+                }
+            }
+            return entries;
+        };
+        long long countA(countNonzeros(valsA, nodeA->GetNumTensorVals()));
+        long long countB(countNonzeros(valsB, nodeB->GetNumTensorVals()));
+        double densityA(static_cast<double>(countA) / nodeA->GetNumTensorVals());
+        double densityB(static_cast<double>(countB) / nodeB->GetNumTensorVals());
+        if (std::min(densityA, densityB) > SPARSE_DENSITY_THRESHOLD) {
+            return false;
+        }
+        //the sparser node is walked by its nonzero values
+        bool sparseIsA(densityA <= densityB);
+        const std::complex<double> *sparseVals = sparseIsA ? valsA : valsB;
+        const std::complex<double> *otherVals = sparseIsA ? valsB : valsA;
+        bool otherIsSparse(std::max(densityA, densityB) <= SPARSE_DENSITY_THRESHOLD);
+
+        //where each index of the two nodes goes: kept indices to a position of C, joined ones to the other node
+        std::vector<std::pair<int, int>> sparseKept, otherKept; //(index in the node, position in C)
+        for (int i(0); i < toNotSumOn.size(); ++i) {
+            (toNotSumOn[i].first == sparseIsA ? sparseKept : otherKept).push_back({toNotSumOn[i].second, i});
+        }
+        std::vector<std::pair<int, int>> joined; //(index in the sparse node, index in the other node)
+        for (const auto &pair: toSumOn) {
+            joined.push_back(sparseIsA ? pair : std::make_pair(pair.second, pair.first));
+        }
+        auto digit = [](unsigned long long entry, int index) { return (entry >> (2 * index)) % 4; };
+
+        unsigned long long sizeC(1ULL << (2 * toNotSumOn.size()));
+        std::fill(valsC, valsC + sizeC, 0.0);
+        //the nonzero values of the other node, grouped by the digits of its joined indices (if it is sparse), or else the
+        //offsets, in C and in the other node, of every value of its kept indices
+        std::vector<std::vector<std::pair<unsigned long long, unsigned long long>>> groups;
+        std::vector<std::pair<unsigned long long, unsigned long long>> offsets{{0, 0}};
+        if (otherIsSparse) {
+            std::vector<unsigned long long> otherEntries(sparseIsA ? nonzeros(valsB, nodeB->GetNumTensorVals(), countB)
+                                                                   : nonzeros(valsA, nodeA->GetNumTensorVals(), countA));
+            groups.resize(1ULL << (2 * joined.size()));
+            for (unsigned long long entry: otherEntries) {
+                unsigned long long key(0), offsetC(0);
+                for (int j(0); j < joined.size(); ++j) {
+                    key += digit(entry, joined[j].second) << (2 * j);
+                }
+                for (const auto &kept: otherKept) {
+                    offsetC += digit(entry, kept.first) << (2 * kept.second);
+                }
+                groups[key].push_back({entry, offsetC});
+            }
+        } else {
+            for (const auto &kept: otherKept) {
+                std::vector<std::pair<unsigned long long, unsigned long long>> next;
+                next.reserve(4 * offsets.size());
+                for (unsigned long long d(0); d < 4; ++d) {
+                    for (const auto &offset: offsets) {
+                        next.push_back({offset.first + (d << (2 * kept.second)), offset.second + (d << (2 * kept.first))});
+                    }
+                }
+                offsets.swap(next);
+            }
+        }
+
+        //the nonzero values of the sparse node with the position in C of their kept indices - values with the same
+        //position add into the same values of C
+        std::vector<std::pair<unsigned long long, unsigned long long>> walk; //(position in C, entry)
+        walk.reserve(sparseIsA ? countA : countB);
+        for (unsigned long long entry(0); entry < (sparseIsA ? nodeA : nodeB)->GetNumTensorVals(); ++entry) {
+            if (sparseVals[entry] == 0.0) {
+                continue;
+            }
+            unsigned long long baseC(0);
+            for (const auto &kept: sparseKept) {
+                baseC += digit(entry, kept.first) << (2 * kept.second);
+            }
+            walk.push_back({baseC, entry});
+        }
+        auto walkRange = [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i(begin); i < end; ++i) {
+                if ((i - begin) % TIME_CHECK_INTERVAL == 0 && totTimer.getElapsed() >= maxTime) {
+                    return;
+                }
+                unsigned long long baseC(walk[i].first), entry(walk[i].second);
+                const std::complex<double> value(sparseVals[entry]);
+                if (otherIsSparse) {
+                    unsigned long long key(0);
+                    for (int j(0); j < joined.size(); ++j) {
+                        key += digit(entry, joined[j].first) << (2 * j);
+                    }
+                    for (const auto &match: groups[key]) {
+                        valsC[baseC + match.second] += value * otherVals[match.first];
+                    }
+                } else {
+                    unsigned long long baseOther(0);
+                    for (const auto &pair: joined) {
+                        baseOther += digit(entry, pair.first) << (2 * pair.second);
+                    }
+                    for (const auto &offset: offsets) {
+                        valsC[baseC + offset.first] += value * otherVals[baseOther + offset.second];
+                    }
+                }
+            }
+        };
+
+        //a large result is split between the threads by position in C, so no two threads add into the same value
+        int numThreads(toNotSumOn.size() >= THRESH_RANK_THREAD ? std::min<long long>(mNumberOfThreads, walk.size()) : 1);
+        if (numThreads > 1) {
+            std::sort(walk.begin(), walk.end());
+            std::vector<std::size_t> bounds{0};
+            for (int t(1); t < numThreads; ++t) {
+                std::size_t bound(std::max(bounds.back(), walk.size() * t / numThreads));
+                while (bound > bounds.back() && bound < walk.size() && walk[bound].first == walk[bound - 1].first) {
+                    ++bound;
+                }
+                bounds.push_back(bound);
+            }
+            bounds.push_back(walk.size());
+            std::vector<std::thread> threads;
+            for (int t(0); t < numThreads - 1; ++t) {
+                threads.push_back(std::thread(walkRange, bounds[t], bounds[t + 1]));
+            }
+            walkRange(bounds[numThreads - 1], bounds[numThreads]);
+            for (auto &tem: threads) {
+                tem.join();
+            }
+        } else {
+            walkRange(0, walk.size());
+        }
+        return true;
+    }
 
 //this function takes in a string input line and populates an output vector with all of the tokens in the line
 //the function avoids all lines that begin with '#' and uses a space as its delimiter
@@ -1009,6 +1977,29 @@ namespace qtorch {
     }
 
 
+/*This function contracts every uncontracted rank 1 node (initial states, measurements and traces) into the gate on the
+ * other end of its wire, so the network is planned without them and every gate next to the boundary has one index fewer.
+ * A rank 1 node joined to another rank 1 node (a qubit without gates) is left alone. The measurements can no longer be
+ * changed afterwards - use it on a clone (see Clone) to keep them
+ */
+    void Network::AbsorbBoundaryNodes() {
+        std::vector<std::shared_ptr<Node>> boundaryNodes;
+        std::copy_if(mUncontractedNodes.begin(), mUncontractedNodes.end(), std::back_inserter(boundaryNodes),
+                     [](const std::shared_ptr<Node> &node) { return node->mRank == 1; });
+        for (const auto &boundaryNode: boundaryNodes) {
+            if (boundaryNode->mContracted) {
+                continue;
+            }
+            const std::shared_ptr<Wire> &tempWire = boundaryNode->GetWires()[0];
+            std::shared_ptr<Node> neighbor(tempWire->GetNodeA().lock() == boundaryNode ? tempWire->GetNodeB().lock()
+                                                                                      : tempWire->GetNodeA().lock());
+            if (!neighbor || neighbor->mRank < 2 || mUncontractedNodes.size() <= 2) {
+                continue;
+            }
+            ContractNodes(boundaryNode, neighbor, 0);
+        }
+    }
+
 /*This function takes the tensor network and reduces it, contracting any one qubit gates or two qubit gates in succession
  * it updates mNodesByWire with the resulting circuit. Note that mAllNodes and mUncontractedNodes are also updated
  */
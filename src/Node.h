@@ -27,6 +27,8 @@ See the License for the specific language governing permissions and
  * The class is a hierarchy where certain types of gates inherit from the general node class
  * The possible gates are listed in the gate type enum and are initialized within their constructors
  * All of the initial values for each gate have been precalculated and are the respective tensor superoperators
+ * Each gate's values are written by its static FillTensor function once per distinct gate and shared by every node of
+ * that gate through the TensorCache - a node only fetches them when they are first read
  *
  * The node class contains the following functions:
  * Access - this function allows the user to access a certain index in the tensor ijkl... and uses a simple algorithm
@@ -50,6 +52,10 @@ See the License for the specific language governing permissions and
 #include <map>
 #include <numeric>
 #include <random>
+#include <memory>
+#include <stdexcept>
+#include <mutex>
+#include <cstdint>
 
 /* READ ME
  * Class: Node
@@ -97,6 +103,7 @@ namespace qtorch {
         CRK,
         CZ,
         CPHASE,
+        RZZ,
         INITSTATE,
         MEASURETRACE,
         INTERMEDIATESTATE,
@@ -107,10 +114,28 @@ namespace qtorch {
 
     class Node {
     public:
+        typedef void (*TensorFiller)(Node &node, const double tensorParameter); //writes a gate's tensor into a node
+
         int mRank;
 
         explicit Node(int rank0) : mRank(rank0), mSelectedInCostContractionAlgorithm(false),
-                                   mContracted(false) { mVals.resize(pow(4, rank0), 0.0); };
+                                   mContracted(false) { AllocateTensorVals(static_cast<long long>(pow(4, rank0))); };
+
+        //creates a node whose values live in an existing buffer (e.g. a snapshot mapping) - the buffer is shared, not copied
+        Node(int rank0, std::shared_ptr<std::complex<double>> vals, long long numVals) : mRank(rank0),
+                                                                                          mSelectedInCostContractionAlgorithm(false),
+                                                                                          mContracted(false),
+                                                                                          mVals(std::move(vals)),
+                                                                                          mNumVals(numVals) {};
+
+        //creates a gate node whose values are filled in by fillTensor(node, tensorParameter) - they are only looked up in
+        //the TensorCache when they are first read, and then shared with every other node of the same gate
+        Node(int rank0, TensorFiller fillTensor, const double tensorParameter = 0.0) : mRank(rank0),
+                                                                                        mSelectedInCostContractionAlgorithm(false),
+                                                                                        mContracted(false),
+                                                                                        mNumVals(static_cast<long long>(pow(4, rank0))),
+                                                                                        mFillTensor(fillTensor),
+                                                                                        mTensorParameter(tensorParameter) {};
 
         inline const std::complex<double> &Access(const std::vector<int> &indexVect);
 
@@ -134,12 +159,34 @@ namespace qtorch {
 
         inline const std::string &GetTypeOfNodeString() const { return mStringType; };
 
-        inline void ClearNodeData() { mVals = std::vector<std::complex<double>>(); };
+        inline void ClearNodeData() {
+            mVals.reset();
+            mNumVals = 0;
+            mFillTensor = nullptr;
+        };
+        inline void SetAngle(const double angle);
+
+        //takes on the type and values of another node of the same rank, sharing its tensor (e.g. to swap a measurement)
+        inline void ShareTensor(const Node &other) {
+            mType = other.mType;
+            mStringType = other.mStringType;
+            mVals = other.mVals;
+            mNumVals = other.mNumVals;
+            mFillTensor = other.mFillTensor;
+            mTensorParameter = other.mTensorParameter;
+            mDiagonal = other.mDiagonal;
+            mPermutation = other.mPermutation;
+        };
+
         int mID;
         int mIndexOfPreviousNode;
         bool mContracted;
         std::pair<int, int> mCreatedFrom;
         bool mSelectedInCostContractionAlgorithm;
+        bool mDiagonal{false}; //for gates whose superoperator is diagonal: nonzero only where each input index equals the matching output index
+        bool mPermutation{false}; //for gates whose superoperator permutes the basis: a single value of 1 for each input index
+        int mParameterSlot{-1}; //for parameterized rotation/phase gates: the parameter this gate's angle is bound to, else -1
+        double mParameterScale{1.0}; //the gate's angle is mParameterScale * (value of parameter mParameterSlot)
 
         std::vector<std::shared_ptr<Wire>> &GetWires() {
             if (mWires.size() > mRank) {
@@ -148,7 +195,32 @@ namespace qtorch {
             return mWires;
         };
 
-        std::vector<std::complex<double>> &GetTensorVals() { return mVals; };
+        //returns a copy of the tensor values
+        std::vector<std::complex<double>> GetTensorVals() const {
+            MaterializeTensorVals();
+            return mVals ? std::vector<std::complex<double>>(mVals.get(), mVals.get() + mNumVals)
+                         : std::vector<std::complex<double>>();
+        };
+
+        inline long long GetNumTensorVals() const { return mNumVals; };
+
+        //read-only pointer to the tensor values
+        inline const std::complex<double> *GetTensorData() const {
+            MaterializeTensorVals();
+            return mVals.get();
+        };
+
+        //writable pointer to the tensor values - copies the values first if they are shared with another node or a mapping
+        inline std::complex<double> *GetWritableTensorData() {
+            DetachTensorVals();
+            return mVals.get();
+        };
+
+        //the buffer holding the tensor values, so that other nodes can share it
+        inline const std::shared_ptr<std::complex<double>> &GetSharedTensorVals() const {
+            MaterializeTensorVals();
+            return mVals;
+        };
 
         virtual ~Node() = default;
         Node(Node&&) = default;
@@ -157,7 +229,27 @@ namespace qtorch {
         Node& operator=(Node&&) = default;
 
     private:
-        std::vector<std::complex<double>> mVals;
+        inline void AllocateTensorVals(const long long numVals) {
+            mVals = std::shared_ptr<std::complex<double>>(new std::complex<double>[numVals](),
+                                                          std::default_delete<std::complex<double>[]>());
+            mNumVals = numVals;
+        };
+
+        inline void MaterializeTensorVals() const;
+
+        inline void DetachTensorVals() {
+            MaterializeTensorVals();
+            if (mVals && !mVals.unique()) {
+                std::shared_ptr<std::complex<double>> shared(mVals);
+                AllocateTensorVals(mNumVals);
+                std::copy(shared.get(), shared.get() + mNumVals, mVals.get());
+            }
+        };
+
+        mutable std::shared_ptr<std::complex<double>> mVals; //the tensor values - shared between nodes (or a snapshot mapping) until written to
+        long long mNumVals{0};
+        TensorFiller mFillTensor{nullptr}; //for gate nodes: how to make the values if mVals hasn't been looked up yet
+        double mTensorParameter{0.0}; //the angle (or other parameter) passed to mFillTensor
         std::vector<std::shared_ptr<Wire>> mWires;
         std::vector<int> mWireNumbers;
     protected:
@@ -172,7 +264,7 @@ namespace qtorch {
             sum += t << (2 * multiplier);
             ++multiplier;
         });
-        return mVals.at(sum);
+        return Access(static_cast<long long>(sum));
     }
 
     inline std::complex<double> &Node::Index(const std::vector<int> &indexVect) {
@@ -182,321 +274,508 @@ namespace qtorch {
             sum += static_cast<unsigned long>(t) * multiplier;
             multiplier *= 4;
         });
-        return mVals[sum];
+        return Index(static_cast<long long>(sum));
     }
 
     inline std::complex<double> &Node::Index(const long long &index) {
-        return mVals[index];
+        DetachTensorVals();
+        return mVals.get()[index];
     }
 
     inline const std::complex<double> &Node::Access(const long long &index) {
-        return mVals.at(index);
+        if (index < 0 || index >= mNumVals) {
+            throw std::out_of_range("Node::Access");
+        }
+        MaterializeTensorVals();
+        return mVals.get()[index];
+    }
+
+
+/*
+ * The TensorCache is a process wide flyweight store of gate tensors: every distinct gate (fill function + parameter, e.g.
+ * H, or Rz at one angle) is computed once and all nodes of that gate share the same values. The cache keeps a reference to
+ * each tensor, so a node's copy-on-write always copies before writing and the cached values are never modified.
+ * Tensors that no node uses any more are dropped whenever the cache has doubled in size, so rebinding angles many times
+ * does not grow it without bound
+ */
+    class TensorCache {
+    public:
+        static std::shared_ptr<std::complex<double>>
+        Get(Node::TensorFiller fillTensor, const double tensorParameter, const int rank) {
+            static std::mutex cacheLock;
+            static std::map<std::pair<std::uintptr_t, double>, std::shared_ptr<std::complex<double>>> cache;
+            static std::size_t pruneAt(64);
+
+            std::pair<std::uintptr_t, double> key{reinterpret_cast<std::uintptr_t>(fillTensor), tensorParameter};
+            std::lock_guard<std::mutex> guard(cacheLock);
+            auto cached = cache.find(key);
+            if (cached != cache.end()) {
+                return cached->second;
+            }
+            if (cache.size() >= pruneAt) {
+                for (auto it = cache.begin(); it != cache.end();) {
+                    it = it->second.unique() ? cache.erase(it) : std::next(it);
+                }
+                pruneAt = std::max(pruneAt, 2 * cache.size());
+            }
+            Node tensor(rank);
+            fillTensor(tensor, tensorParameter);
+            cache.insert({key, tensor.GetSharedTensorVals()});
+            return tensor.GetSharedTensorVals();
+        };
+    };
+
+//this function looks up the values of a gate node in the TensorCache the first time they are needed. It is called by the
+//const accessors, so threads that read the same node may race to it: mVals is read and set atomically, and only the
+//first lookup to finish is kept (the others get the same cached values anyway)
+    inline void Node::MaterializeTensorVals() const {
+        if (mFillTensor && !std::atomic_load(&mVals)) {
+            std::shared_ptr<std::complex<double>> looked(TensorCache::Get(mFillTensor, mTensorParameter, mRank));
+            std::shared_ptr<std::complex<double>> empty;
+            std::atomic_compare_exchange_strong(&mVals, &empty, looked);
+        }
     }
 
 
     class CNOTNode : public Node {
     public:
-        CNOTNode() : Node(4) {
-            Index({0, 0, 0, 0}) = 1;
-            Index({0, 1, 0, 1}) = 1;
-            Index({0, 2, 0, 2}) = 1;
-            Index({0, 3, 0, 3}) = 1;
-            Index({1, 0, 1, 1}) = 1;
-            Index({1, 1, 1, 0}) = 1;
-            Index({1, 2, 1, 3}) = 1;
-            Index({1, 3, 1, 2}) = 1;
-            Index({2, 0, 2, 2}) = 1;
-            Index({2, 1, 2, 3}) = 1;
-            Index({2, 2, 2, 0}) = 1;
-            Index({2, 3, 2, 1}) = 1;
-            Index({3, 0, 3, 3}) = 1;
-            Index({3, 1, 3, 2}) = 1;
-            Index({3, 2, 3, 1}) = 1;
-            Index({3, 3, 3, 0}) = 1;
+        CNOTNode() : Node(4, FillTensor) {
             mType = GateType::CNOT;
             mStringType = ("CNOT");
+            mPermutation = true;
+        };
+
+        //writes the superoperator into a node of rank 4
+        static void FillTensor(Node &node, const double) {
+            node.Index({0, 0, 0, 0}) = 1;
+            node.Index({0, 1, 0, 1}) = 1;
+            node.Index({0, 2, 0, 2}) = 1;
+            node.Index({0, 3, 0, 3}) = 1;
+            node.Index({1, 0, 1, 1}) = 1;
+            node.Index({1, 1, 1, 0}) = 1;
+            node.Index({1, 2, 1, 3}) = 1;
+            node.Index({1, 3, 1, 2}) = 1;
+            node.Index({2, 0, 2, 2}) = 1;
+            node.Index({2, 1, 2, 3}) = 1;
+            node.Index({2, 2, 2, 0}) = 1;
+            node.Index({2, 3, 2, 1}) = 1;
+            node.Index({3, 0, 3, 3}) = 1;
+            node.Index({3, 1, 3, 2}) = 1;
+            node.Index({3, 2, 3, 1}) = 1;
+            node.Index({3, 3, 3, 0}) = 1;
         };
 
     };
 
     class RxNode : public Node {
     public:
-        RxNode(const double tempPhaseVal) : Node(2) {
-            Index({0, 0}) = pow(cos(tempPhaseVal / 2.0), 2);
-            Index({0, 1}) = std::complex<double>(0.0, (sin(tempPhaseVal) / 2.0));
-            Index({0, 2}) = std::complex<double>(0.0, -1.0 * (sin(tempPhaseVal) / 2.0));
-            Index({0, 3}) = pow(sin(tempPhaseVal / 2.0), 2);
-            Index({1, 0}) = std::complex<double>(0.0, (sin(tempPhaseVal) / 2.0));
-            Index({1, 1}) = pow(cos(tempPhaseVal / 2.0), 2);
-            Index({1, 2}) = pow(sin(tempPhaseVal / 2.0), 2);
-            Index({1, 3}) = std::complex<double>(0.0, -1.0 * (sin(tempPhaseVal) / 2.0));
-            Index({2, 0}) = std::complex<double>(0.0, -1.0 * (sin(tempPhaseVal) / 2.0));
-            Index({2, 1}) = pow(sin(tempPhaseVal / 2.0), 2);
-            Index({2, 2}) = pow(cos(tempPhaseVal / 2.0), 2);
-            Index({2, 3}) = std::complex<double>(0.0, (sin(tempPhaseVal) / 2.0));
-            Index({3, 0}) = pow(sin(tempPhaseVal / 2.0), 2);
-            Index({3, 1}) = std::complex<double>(0.0, -1.0 * (sin(tempPhaseVal) / 2.0));
-            Index({3, 2}) = std::complex<double>(0.0, (sin(tempPhaseVal) / 2.0));
-            Index({3, 3}) = pow(cos(tempPhaseVal / 2.0), 2);
+        RxNode(const double tempPhaseVal) : Node(2, FillTensor, tempPhaseVal) {
             mType = GateType::RX;
             mStringType = ("Rx");
         };
+
+        //writes the superoperator for the given angle into a node of rank 2
+        static void FillTensor(Node &node, const double tempPhaseVal) {
+            node.Index({0, 0}) = pow(cos(tempPhaseVal / 2.0), 2);
+            node.Index({0, 1}) = std::complex<double>(0.0, (sin(tempPhaseVal) / 2.0));
+            node.Index({0, 2}) = std::complex<double>(0.0, -1.0 * (sin(tempPhaseVal) / 2.0));
+            node.Index({0, 3}) = pow(sin(tempPhaseVal / 2.0), 2);
+            node.Index({1, 0}) = std::complex<double>(0.0, (sin(tempPhaseVal) / 2.0));
+            node.Index({1, 1}) = pow(cos(tempPhaseVal / 2.0), 2);
+            node.Index({1, 2}) = pow(sin(tempPhaseVal / 2.0), 2);
+            node.Index({1, 3}) = std::complex<double>(0.0, -1.0 * (sin(tempPhaseVal) / 2.0));
+            node.Index({2, 0}) = std::complex<double>(0.0, -1.0 * (sin(tempPhaseVal) / 2.0));
+            node.Index({2, 1}) = pow(sin(tempPhaseVal / 2.0), 2);
+            node.Index({2, 2}) = pow(cos(tempPhaseVal / 2.0), 2);
+            node.Index({2, 3}) = std::complex<double>(0.0, (sin(tempPhaseVal) / 2.0));
+            node.Index({3, 0}) = pow(sin(tempPhaseVal / 2.0), 2);
+            node.Index({3, 1}) = std::complex<double>(0.0, -1.0 * (sin(tempPhaseVal) / 2.0));
+            node.Index({3, 2}) = std::complex<double>(0.0, (sin(tempPhaseVal) / 2.0));
+            node.Index({3, 3}) = pow(cos(tempPhaseVal / 2.0), 2);
+        };
     };
 
     class RyNode : public Node {
     public:
-        RyNode(const double tempPhaseVal) : Node(2) {
-            double debug = sin(tempPhaseVal) / 2.0;
-            Index({0, 0}) = pow(cos(tempPhaseVal / 2.0), 2);
-            Index({0, 1}) = sin(tempPhaseVal) / 2.0;
-            Index({0, 2}) = sin(tempPhaseVal) / 2.0;
-            Index({0, 3}) = pow(sin(tempPhaseVal / 2.0), 2);
-            Index({1, 0}) = -1.0 * sin(tempPhaseVal) / 2.0;
-            Index({1, 1}) = pow(cos(tempPhaseVal / 2.0), 2);
-            Index({1, 2}) = -1.0 * pow(sin(tempPhaseVal / 2), 2);
-            Index({1, 3}) = sin(tempPhaseVal) / 2.0;
-            Index({2, 0}) = -1.0 * sin(tempPhaseVal) / 2.0;
-            Index({2, 1}) = -1.0 * pow(sin(tempPhaseVal / 2.0), 2);
-            Index({2, 2}) = pow(cos(tempPhaseVal / 2.0), 2);
-            Index({2, 3}) = sin(tempPhaseVal) / 2.0;
-            Index({3, 0}) = pow(sin(tempPhaseVal / 2.0), 2);
-            Index({3, 1}) = -1.0 * sin(tempPhaseVal) / 2.0;
-            Index({3, 2}) = -1.0 * sin(tempPhaseVal) / 2.0;
-            Index({3, 3}) = pow(cos(tempPhaseVal / 2.0), 2);
+        RyNode(const double tempPhaseVal) : Node(2, FillTensor, tempPhaseVal) {
             mType = GateType::RY;
             mStringType = ("Ry");
         };
+
+        //writes the superoperator for the given angle into a node of rank 2
+        static void FillTensor(Node &node, const double tempPhaseVal) {
+            node.Index({0, 0}) = pow(cos(tempPhaseVal / 2.0), 2);
+            node.Index({0, 1}) = sin(tempPhaseVal) / 2.0;
+            node.Index({0, 2}) = sin(tempPhaseVal) / 2.0;
+            node.Index({0, 3}) = pow(sin(tempPhaseVal / 2.0), 2);
+            node.Index({1, 0}) = -1.0 * sin(tempPhaseVal) / 2.0;
+            node.Index({1, 1}) = pow(cos(tempPhaseVal / 2.0), 2);
+            node.Index({1, 2}) = -1.0 * pow(sin(tempPhaseVal / 2), 2);
+            node.Index({1, 3}) = sin(tempPhaseVal) / 2.0;
+            node.Index({2, 0}) = -1.0 * sin(tempPhaseVal) / 2.0;
+            node.Index({2, 1}) = -1.0 * pow(sin(tempPhaseVal / 2.0), 2);
+            node.Index({2, 2}) = pow(cos(tempPhaseVal / 2.0), 2);
+            node.Index({2, 3}) = sin(tempPhaseVal) / 2.0;
+            node.Index({3, 0}) = pow(sin(tempPhaseVal / 2.0), 2);
+            node.Index({3, 1}) = -1.0 * sin(tempPhaseVal) / 2.0;
+            node.Index({3, 2}) = -1.0 * sin(tempPhaseVal) / 2.0;
+            node.Index({3, 3}) = pow(cos(tempPhaseVal / 2.0), 2);
+        };
     };
 
     class RzNode : public Node {
     public:
-        RzNode(const double tempPhaseVal) : Node(2) {
-            Index({0, 0}) = 1.0;
-            Index({1, 1}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
-            Index({2, 2}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
-            Index({3, 3}) = 1.0;
+        RzNode(const double tempPhaseVal) : Node(2, FillTensor, tempPhaseVal) {
             mType = GateType::RZ;
             mStringType = ("Rz");
+            mDiagonal = true;
+        };
+
+        //writes the superoperator for the given angle into a node of rank 2
+        static void FillTensor(Node &node, const double tempPhaseVal) {
+            node.Index({0, 0}) = 1.0;
+            node.Index({1, 1}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
+            node.Index({2, 2}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
+            node.Index({3, 3}) = 1.0;
         };
     };
     
     
     class PhaseNode : public Node {
     public:
-        PhaseNode(const double tempPhaseVal) : Node(2) {
-            Index({0, 0}) = 1.0;
-            Index({1, 1}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
-            Index({2, 2}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
-            Index({3, 3}) = 1.0;
+        PhaseNode(const double tempPhaseVal) : Node(2, FillTensor, tempPhaseVal) {
             mType = GateType::PHASE;
             mStringType = ("Phase");
+            mDiagonal = true;
+        };
+
+        //writes the superoperator for the given angle into a node of rank 2
+        static void FillTensor(Node &node, const double tempPhaseVal) {
+            node.Index({0, 0}) = 1.0;
+            node.Index({1, 1}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
+            node.Index({2, 2}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
+            node.Index({3, 3}) = 1.0;
         };
     };
 
     class HNode : public Node {
     public:
-        HNode() : Node(2) {
-            Index({0, 0}) = 1.0 / 2.0;
-            Index({0, 1}) = 1.0 / 2.0;
-            Index({0, 2}) = 1.0 / 2.0;
-            Index({0, 3}) = 1.0 / 2.0;
-            Index({1, 0}) = 1.0 / 2.0;
-            Index({1, 1}) = -1.0 / 2.0;
-            Index({1, 2}) = 1.0 / 2.0;
-            Index({1, 3}) = -1.0 / 2.0;
-            Index({2, 0}) = 1.0 / 2.0;
-            Index({2, 1}) = 1.0 / 2.0;
-            Index({2, 2}) = -1.0 / 2.0;
-            Index({2, 3}) = -1.0 / 2.0;
-            Index({3, 0}) = 1.0 / 2.0;
-            Index({3, 1}) = -1.0 / 2.0;
-            Index({3, 2}) = -1.0 / 2.0;
-            Index({3, 3}) = 1.0 / 2.0;
+        HNode() : Node(2, FillTensor) {
             mType = GateType::HADAMARD;
             mStringType = ("H");
         };
+
+        //writes the superoperator into a node of rank 2
+        static void FillTensor(Node &node, const double) {
+            node.Index({0, 0}) = 1.0 / 2.0;
+            node.Index({0, 1}) = 1.0 / 2.0;
+            node.Index({0, 2}) = 1.0 / 2.0;
+            node.Index({0, 3}) = 1.0 / 2.0;
+            node.Index({1, 0}) = 1.0 / 2.0;
+            node.Index({1, 1}) = -1.0 / 2.0;
+            node.Index({1, 2}) = 1.0 / 2.0;
+            node.Index({1, 3}) = -1.0 / 2.0;
+            node.Index({2, 0}) = 1.0 / 2.0;
+            node.Index({2, 1}) = 1.0 / 2.0;
+            node.Index({2, 2}) = -1.0 / 2.0;
+            node.Index({2, 3}) = -1.0 / 2.0;
+            node.Index({3, 0}) = 1.0 / 2.0;
+            node.Index({3, 1}) = -1.0 / 2.0;
+            node.Index({3, 2}) = -1.0 / 2.0;
+            node.Index({3, 3}) = 1.0 / 2.0;
+        };
     };
 
     class XNode : public Node {
     public:
-        XNode() : Node(2) {
-            Index({0, 3}) = 1;
-            Index({1, 2}) = 1;
-            Index({2, 1}) = 1;
-            Index({3, 0}) = 1;
+        XNode() : Node(2, FillTensor) {
             mType = GateType::X;
             mStringType = ("X");
+            mPermutation = true;
+        };
+
+        //writes the superoperator into a node of rank 2
+        static void FillTensor(Node &node, const double) {
+            node.Index({0, 3}) = 1;
+            node.Index({1, 2}) = 1;
+            node.Index({2, 1}) = 1;
+            node.Index({3, 0}) = 1;
         };
     };
 
     class YNode : public Node {
     public:
-        YNode() : Node(2) {
-            Index({0, 3}) = 1;
-            Index({1, 2}) = -1;
-            Index({2, 1}) = -1;
-            Index({3, 0}) = 1;
+        YNode() : Node(2, FillTensor) {
             mType = GateType::Y;
             mStringType = ("Y");
         };
+
+        //writes the superoperator into a node of rank 2
+        static void FillTensor(Node &node, const double) {
+            node.Index({0, 3}) = 1;
+            node.Index({1, 2}) = -1;
+            node.Index({2, 1}) = -1;
+            node.Index({3, 0}) = 1;
+        };
     };
 
     class ZNode : public Node {
     public:
-        ZNode() : Node(2) {
-            Index({0, 0}) = 1.0;
-            Index({1, 1}) = -1.0;
-            Index({2, 2}) = -1.0;
-            Index({3, 3}) = 1.0;
+        ZNode() : Node(2, FillTensor) {
             mType = GateType::Z;
             mStringType = ("Z");
+            mDiagonal = true;
+        };
+
+        //writes the superoperator into a node of rank 2
+        static void FillTensor(Node &node, const double) {
+            node.Index({0, 0}) = 1.0;
+            node.Index({1, 1}) = -1.0;
+            node.Index({2, 2}) = -1.0;
+            node.Index({3, 3}) = 1.0;
         };
     };
 
     class ZeroStateNode : public Node {
     public:
-        ZeroStateNode() : Node(1) {
-            Index({0}) = 1;
+        ZeroStateNode() : Node(1, FillTensor) {
             mType = GateType::INITSTATE;
             mStringType = ("|0><0|");
         };
+
+        //writes the initial state into a node of rank 1
+        static void FillTensor(Node &node, const double) {
+            node.Index({0}) = 1;
+        };
     };
 
     class TraceNode : public Node {
     public:
-        TraceNode() : Node(1) {
-            Index({0}) = 1.0;
-            Index({3}) = 1.0;
+        TraceNode() : Node(1, FillTensor) {
             mType = GateType::MEASURETRACE;
             mStringType = ("Trace");
         };
+
+        //writes the trace into a node of rank 1
+        static void FillTensor(Node &node, const double) {
+            node.Index({0}) = 1.0;
+            node.Index({3}) = 1.0;
+        };
     };
 
     class XMeasure : public Node {
     public:
-        XMeasure() : Node(1) {
-            Index({1}) = 1.0;
-            Index({2}) = 1.0;
+        XMeasure() : Node(1, FillTensor) {
             mType = GateType::MEASURETRACE;
             mStringType = ("X measure");
         };
+
+        //writes the measurement operator into a node of rank 1
+        static void FillTensor(Node &node, const double) {
+            node.Index({1}) = 1.0;
+            node.Index({2}) = 1.0;
+        };
     };
 
     class YMeasure : public Node {
     public:
-        YMeasure() : Node(1) {
-            Index({1}) = std::complex<double>(0, 1.0);
-            Index({2}) = std::complex<double>(0, -1.0);
+        YMeasure() : Node(1, FillTensor) {
             mType = GateType::MEASURETRACE;
             mStringType = ("Y measure");
         };
+
+        //writes the measurement operator into a node of rank 1
+        static void FillTensor(Node &node, const double) {
+            node.Index({1}) = std::complex<double>(0, 1.0);
+            node.Index({2}) = std::complex<double>(0, -1.0);
+        };
     };
 
     class ZMeasure : public Node {
     public:
-        ZMeasure() : Node(1) {
-            Index({0}) = 1.0;
-            Index({3}) = -1.0;
+        ZMeasure() : Node(1, FillTensor) {
             mType = GateType::MEASURETRACE;
             mStringType = ("Z measure");
         };
+
+        //writes the measurement operator into a node of rank 1
+        static void FillTensor(Node &node, const double) {
+            node.Index({0}) = 1.0;
+            node.Index({3}) = -1.0;
+        };
     };
 
     class ProjectOne : public Node {
     public:
-        ProjectOne() : Node(1) {
-            Index({3}) = 1;
+        ProjectOne() : Node(1, FillTensor) {
             mType = GateType::MEASURETRACE;
             mStringType = ("|1><1| measure");
         };
+
+        //writes the measurement operator into a node of rank 1
+        static void FillTensor(Node &node, const double) {
+            node.Index({3}) = 1;
+        };
     };
 
     class ProjectZero : public Node {
     public:
-        ProjectZero() : Node(1) {
-            Index({0}) = 1;
+        ProjectZero() : Node(1, FillTensor) {
             mType = GateType::MEASURETRACE;
             mStringType = ("|0><0| measure");
         };
+
+        //writes the measurement operator into a node of rank 1
+        static void FillTensor(Node &node, const double) {
+            node.Index({0}) = 1;
+        };
     };
 
 
     class CRkNode : public Node {
     public:
-        CRkNode(int controlBit) : Node(4) {
-            Index({0, 0, 0, 0}) = 1.0;
-            Index({0, 1, 0, 1}) = 1.0;
-            Index({0, 2, 0, 2}) = 1.0;
-            Index({0, 3, 0, 3}) = 1.0;
-            Index({1, 0, 1, 0}) = 1.0;
-            Index({1, 1, 1, 1}) = exp(2.0 * PI * std::complex<double>(0, -1) / pow(2, controlBit + 1.0));
-            Index({1, 2, 1, 2}) = 1.0;
-            Index({1, 3, 1, 3}) = exp(2.0 * PI * std::complex<double>(0, -1) / pow(2, controlBit + 1.0));
-            Index({2, 0, 2, 0}) = 1.0;
-            Index({2, 1, 2, 1}) = 1.0;
-            Index({2, 2, 2, 2}) = exp(2.0 * PI * std::complex<double>(0, 1) / pow(2, controlBit + 1.0));
-            Index({2, 3, 2, 3}) = exp(2.0 * PI * std::complex<double>(0, 1) / pow(2, controlBit + 1.0));
-            Index({3, 0, 3, 0}) = 1.0;
-            Index({3, 1, 3, 1}) = exp(2.0 * PI * std::complex<double>(0, -1) / pow(2, controlBit + 1.0));
-            Index({3, 2, 3, 2}) = exp(2.0 * PI * std::complex<double>(0, 1) / pow(2, controlBit + 1.0));
-            Index({3, 3, 3, 3}) = 1.0;
+        CRkNode(int controlBit) : Node(4, FillTensor, controlBit) {
             mType = GateType::CRK;
             mStringType = ("CRk");
+            mDiagonal = true;
         }
 
+        //writes the superoperator for the given control bit into a node of rank 4
+        static void FillTensor(Node &node, const double controlBit) {
+            node.Index({0, 0, 0, 0}) = 1.0;
+            node.Index({0, 1, 0, 1}) = 1.0;
+            node.Index({0, 2, 0, 2}) = 1.0;
+            node.Index({0, 3, 0, 3}) = 1.0;
+            node.Index({1, 0, 1, 0}) = 1.0;
+            node.Index({1, 1, 1, 1}) = exp(2.0 * PI * std::complex<double>(0, -1) / pow(2, controlBit + 1.0));
+            node.Index({1, 2, 1, 2}) = 1.0;
+            node.Index({1, 3, 1, 3}) = exp(2.0 * PI * std::complex<double>(0, -1) / pow(2, controlBit + 1.0));
+            node.Index({2, 0, 2, 0}) = 1.0;
+            node.Index({2, 1, 2, 1}) = 1.0;
+            node.Index({2, 2, 2, 2}) = exp(2.0 * PI * std::complex<double>(0, 1) / pow(2, controlBit + 1.0));
+            node.Index({2, 3, 2, 3}) = exp(2.0 * PI * std::complex<double>(0, 1) / pow(2, controlBit + 1.0));
+            node.Index({3, 0, 3, 0}) = 1.0;
+            node.Index({3, 1, 3, 1}) = exp(2.0 * PI * std::complex<double>(0, -1) / pow(2, controlBit + 1.0));
+            node.Index({3, 2, 3, 2}) = exp(2.0 * PI * std::complex<double>(0, 1) / pow(2, controlBit + 1.0));
+            node.Index({3, 3, 3, 3}) = 1.0;
+        };
+
     };
 
     class CZNode : public Node {
     public:
-        CZNode() : Node(4) {
-            Index({0, 0, 0, 0}) = 1.0;
-            Index({0, 1, 0, 1}) = 1.0;
-            Index({0, 2, 0, 2}) = 1.0;
-            Index({0, 3, 0, 3}) = 1.0;
-            Index({1, 0, 1, 0}) = 1.0;
-            Index({1, 1, 1, 1}) = -1.0;
-            Index({1, 2, 1, 2}) = 1.0;
-            Index({1, 3, 1, 3}) = -1.0;
-            Index({2, 0, 2, 0}) = 1.0;
-            Index({2, 1, 2, 1}) = 1.0;
-            Index({2, 2, 2, 2}) = -1.0;
-            Index({2, 3, 2, 3}) = -1.0;
-            Index({3, 0, 3, 0}) = 1.0;
-            Index({3, 1, 3, 1}) = -1.0;
-            Index({3, 2, 3, 2}) = -1.0;
-            Index({3, 3, 3, 3}) = 1.0;
+        CZNode() : Node(4, FillTensor) {
             mType = GateType::CZ;
             mStringType = ("CZ");
+            mDiagonal = true;
         }
 
+        //writes the superoperator into a node of rank 4
+        static void FillTensor(Node &node, const double) {
+            node.Index({0, 0, 0, 0}) = 1.0;
+            node.Index({0, 1, 0, 1}) = 1.0;
+            node.Index({0, 2, 0, 2}) = 1.0;
+            node.Index({0, 3, 0, 3}) = 1.0;
+            node.Index({1, 0, 1, 0}) = 1.0;
+            node.Index({1, 1, 1, 1}) = -1.0;
+            node.Index({1, 2, 1, 2}) = 1.0;
+            node.Index({1, 3, 1, 3}) = -1.0;
+            node.Index({2, 0, 2, 0}) = 1.0;
+            node.Index({2, 1, 2, 1}) = 1.0;
+            node.Index({2, 2, 2, 2}) = -1.0;
+            node.Index({2, 3, 2, 3}) = -1.0;
+            node.Index({3, 0, 3, 0}) = 1.0;
+            node.Index({3, 1, 3, 1}) = -1.0;
+            node.Index({3, 2, 3, 2}) = -1.0;
+            node.Index({3, 3, 3, 3}) = 1.0;
+        };
+
 
     };
 
     class CPhaseNode : public Node {
     public:
-        CPhaseNode(double tempPhaseVal) : Node(4) {
-            Index({0, 0, 0, 0}) = 1.0;
-            Index({0, 1, 0, 1}) = 1.0;
-            Index({0, 2, 0, 2}) = 1.0;
-            Index({0, 3, 0, 3}) = 1.0;
-            Index({1, 0, 1, 0}) = 1.0;
-            Index({1, 1, 1, 1}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
-            Index({1, 2, 1, 2}) = 1.0;
-            Index({1, 3, 1, 3}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
-            Index({2, 0, 2, 0}) = 1.0;
-            Index({2, 1, 2, 1}) = 1.0;
-            Index({2, 2, 2, 2}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
-            Index({2, 3, 2, 3}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
-            Index({3, 0, 3, 0}) = 1.0;
-            Index({3, 1, 3, 1}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
-            Index({3, 2, 3, 2}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
-            Index({3, 3, 3, 3}) = 1.0;
+        CPhaseNode(const double tempPhaseVal) : Node(4, FillTensor, tempPhaseVal) {
             mStringType = "CPhase";
             mType = GateType::CPHASE;
+            mDiagonal = true;
         }
 
+        //writes the superoperator for the given angle into a node of rank 4
+        static void FillTensor(Node &node, const double tempPhaseVal) {
+            node.Index({0, 0, 0, 0}) = 1.0;
+            node.Index({0, 1, 0, 1}) = 1.0;
+            node.Index({0, 2, 0, 2}) = 1.0;
+            node.Index({0, 3, 0, 3}) = 1.0;
+            node.Index({1, 0, 1, 0}) = 1.0;
+            node.Index({1, 1, 1, 1}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
+            node.Index({1, 2, 1, 2}) = 1.0;
+            node.Index({1, 3, 1, 3}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
+            node.Index({2, 0, 2, 0}) = 1.0;
+            node.Index({2, 1, 2, 1}) = 1.0;
+            node.Index({2, 2, 2, 2}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
+            node.Index({2, 3, 2, 3}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
+            node.Index({3, 0, 3, 0}) = 1.0;
+            node.Index({3, 1, 3, 1}) = std::complex<double>(cos(tempPhaseVal), -1.0 * sin(tempPhaseVal));
+            node.Index({3, 2, 3, 2}) = std::complex<double>(cos(tempPhaseVal), sin(tempPhaseVal));
+            node.Index({3, 3, 3, 3}) = 1.0;
+        };
+
     };
 
+    //the Ising coupling exp(-i angle/2 Z Z), e.g. the cost term of QAOA - replaces CNOT, Rz, CNOT
+    class RzzNode : public Node {
+    public:
+        RzzNode(const double tempPhaseVal) : Node(4, FillTensor, tempPhaseVal) {
+            mStringType = "RZZ";
+            mType = GateType::RZZ;
+            mDiagonal = true;
+        }
+
+        //writes the superoperator for the given angle into a node of rank 4 - the ket and bra phases of the two qubits
+        //are exp(-i angle/2) when their bits agree and exp(i angle/2) when they differ
+        static void FillTensor(Node &node, const double tempPhaseVal) {
+            for (int first(0); first < 4; ++first) {
+                for (int second(0); second < 4; ++second) {
+                    int ketParity((first / 2) ^ (second / 2));
+                    int braParity((first % 2) ^ (second % 2));
+                    double phase((ketParity - braParity) * tempPhaseVal);
+                    node.Index({first, second, first, second}) = std::complex<double>(cos(phase), sin(phase));
+                }
+            }
+        };
+
+    };
+
+//this function changes the angle of a rotation or phase gate (used to rebind parameters). The node drops its values and
+//looks up the tensor for the new angle the next time it is read
+    inline void Node::SetAngle(const double angle) {
+        switch (mType) {
+            case GateType::RX:
+                mFillTensor = RxNode::FillTensor;
+                break;
+            case GateType::RY:
+                mFillTensor = RyNode::FillTensor;
+                break;
+            case GateType::RZ:
+                mFillTensor = RzNode::FillTensor;
+                break;
+            case GateType::PHASE:
+                mFillTensor = PhaseNode::FillTensor;
+                break;
+            case GateType::CPHASE:
+                mFillTensor = CPhaseNode::FillTensor;
+                break;
+            case GateType::RZZ:
+                mFillTensor = RzzNode::FillTensor;
+                break;
+            default:
+                throw InvalidFunctionInput();
+        }
+        mTensorParameter = angle;
+        mVals.reset();
+    }
+
     class DepolarizingChannelNode : public Node {
     public:
         DepolarizingChannelNode(std::mt19937 &gen, std::uniform_real_distribution<float> &randDist) : Node(2) {
@@ -514,31 +793,35 @@ namespace qtorch {
 
     class SwapNode : public Node {
     public:
-        SwapNode() : Node(4) {
+        SwapNode() : Node(4, FillTensor) {
             mType = GateType::SWAP;
             mStringType = ("SWAP");
-
-            Index({0, 0, 0, 0}) = 1.0;
-            Index({0, 1, 1, 0}) = 1.0;
-            Index({1, 0, 0, 1}) = 1.0;
-            Index({1, 1, 1, 1}) = 1.0;
-
-            Index({0, 2, 2, 0}) = 1.0;
-            Index({0, 3, 3, 0}) = 1.0;
-            Index({1, 2, 2, 1}) = 1.0;
-            Index({1, 3, 3, 1}) = 1.0;
-
-            Index({2, 0, 0, 2}) = 1.0;
-            Index({2, 1, 1, 2}) = 1.0;
-            Index({3, 0, 0, 3}) = 1.0;
-            Index({3, 1, 1, 3}) = 1.0;
-
-            Index({2, 2, 2, 2}) = 1.0;
-            Index({2, 3, 3, 2}) = 1.0;
-            Index({3, 2, 2, 3}) = 1.0;
-            Index({3, 3, 3, 3}) = 1.0;
+            mPermutation = true;
         }
 
+        //writes the superoperator into a node of rank 4
+        static void FillTensor(Node &node, const double) {
+            node.Index({0, 0, 0, 0}) = 1.0;
+            node.Index({0, 1, 1, 0}) = 1.0;
+            node.Index({1, 0, 0, 1}) = 1.0;
+            node.Index({1, 1, 1, 1}) = 1.0;
+
+            node.Index({0, 2, 2, 0}) = 1.0;
+            node.Index({0, 3, 3, 0}) = 1.0;
+            node.Index({1, 2, 2, 1}) = 1.0;
+            node.Index({1, 3, 3, 1}) = 1.0;
+
+            node.Index({2, 0, 0, 2}) = 1.0;
+            node.Index({2, 1, 1, 2}) = 1.0;
+            node.Index({3, 0, 0, 3}) = 1.0;
+            node.Index({3, 1, 1, 3}) = 1.0;
+
+            node.Index({2, 2, 2, 2}) = 1.0;
+            node.Index({2, 3, 3, 2}) = 1.0;
+            node.Index({3, 2, 2, 3}) = 1.0;
+            node.Index({3, 3, 3, 3}) = 1.0;
+        };
+
     };
 
     class ArbitraryOneQubitNode : public Node {
@@ -549,9 +832,24 @@ namespace qtorch {
             ParseMatrixValues(inputFile);
         }
 
+        //takes the 4 entries of the unitary directly instead of reading them from a file (row major, see ParseMatrixValues)
+        ArbitraryOneQubitNode(const std::vector<std::complex<double>> &matrix, const std::string &nodeName) : Node(2) {
+            mType = GateType::ARBITRARYONEQUBITUNITARY;
+            mStringType = (nodeName);
+            SetMatrixValues(matrix);
+        }
+
+        //shares the tensor of another node of the same gate (e.g. one made from the same matrix file)
+        ArbitraryOneQubitNode(const std::shared_ptr<std::complex<double>> &vals, const std::string &nodeName) : Node(2, vals, 16) {
+            mType = GateType::ARBITRARYONEQUBITUNITARY;
+            mStringType = (nodeName);
+        }
+
     private:
         void ParseMatrixValues(const std::string &filename);
 
+        void SetMatrixValues(const std::vector<std::complex<double>> &nums);
+
     };
 
     void ArbitraryOneQubitNode::ParseMatrixValues(const std::string &filename) {
@@ -567,6 +865,13 @@ namespace qtorch {
             }
             input >> nums[i];
         }
+        SetMatrixValues(nums);
+    }
+
+    void ArbitraryOneQubitNode::SetMatrixValues(const std::vector<std::complex<double>> &nums) {
+        if (nums.size() != 4) {
+            throw InvalidFunctionInput();
+        }
         Index({0, 0}) = nums[0] * std::conj(nums[0]);
         Index({0, 1}) = nums[0] * std::conj(nums[2]);
         Index({0, 2}) = nums[2] * std::conj(nums[0]);
@@ -593,9 +898,24 @@ namespace qtorch {
             ParseMatrixValues(inputFile);
         }
 
+        //takes the 16 entries of the unitary directly instead of reading them from a file (row major, see ParseMatrixValues)
+        ArbitraryTwoQubitNode(const std::vector<std::complex<double>> &matrix, const std::string &nodeName) : Node(4) {
+            mType = GateType::ARBITRARYTWOQUBITUNITARY;
+            mStringType = (nodeName);
+            SetMatrixValues(matrix);
+        }
+
+        //shares the tensor of another node of the same gate (e.g. one made from the same matrix file)
+        ArbitraryTwoQubitNode(const std::shared_ptr<std::complex<double>> &vals, const std::string &nodeName) : Node(4, vals, 256) {
+            mType = GateType::ARBITRARYTWOQUBITUNITARY;
+            mStringType = (nodeName);
+        }
+
     private:
         void ParseMatrixValues(const std::string &filename);
 
+        void SetMatrixValues(const std::vector<std::complex<double>> &nums);
+
     };
 
     void ArbitraryTwoQubitNode::ParseMatrixValues(const std::string &filename) {
@@ -621,8 +941,13 @@ namespace qtorch {
             std::cout<<num<<" "<<std::endl;
         }
         std::cout<<"\n\n\n";*/
+        SetMatrixValues(nums);
+    }
 
-
+    void ArbitraryTwoQubitNode::SetMatrixValues(const std::vector<std::complex<double>> &nums) {
+        if (nums.size() != 16) {
+            throw InvalidFunctionInput();
+        }
         Index({0, 0, 0, 0}) = nums[0] * std::conj(nums[0]);
         Index({0, 0, 0, 1}) = nums[0] * std::conj(nums[4]);
         Index({0, 0, 0, 2}) = nums[4] * std::conj(nums[0]);
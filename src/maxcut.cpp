@@ -25,8 +25,9 @@ See the License for the specific language governing permissions and
 using namespace qtorch;
 
 //this function finds the string that supposedly solves the maxcut problem given as input a contraction sequence from the preprocessing routine
-//and the optimized gammas and betas.. it prints the answer string and cut data to maxcutAnswerString.txt
-void maxcutGetFinalString(std::string& graphFilePath, int p,std::vector<std::pair<int,int>>& contractionSequence, std::vector<double>& gAndB, const std::string& outfilePath){
+//and the optimized gammas and betas.. it prints the answer string and cut data to maxcutAnswerString.txt. Returns false (and
+//writes no file) if the final state could not be contracted
+bool maxcutGetFinalString(std::string& graphFilePath, int p,std::vector<std::pair<int,int>>& contractionSequence, std::vector<double>& gAndB, const std::string& outfilePath){
     //the goal of this main class is to run the maxcut algorithm on a graph supplied in the command line arguments
     //the class will use qaoa to solve the maxcut problem, outputting a qasm circuit and simulating it for each iteration of of the maximization algorithm
     //the user will specify the "p" and the graph file in the command line, and this class will run a maxcut simulation based on the graph
@@ -39,110 +40,282 @@ void maxcutGetFinalString(std::string& graphFilePath, int p,std::vector<std::pai
     e.outputFile = outfilePath;
 
 
-    auto calculateFinalString = [&z, &contractionSequence](const std::vector<double>& betas_gammas, ExtraData * f_data) {
+    auto calculateFinalString = [&z, &contractionSequence](const std::vector<double>& betas_gammas, ExtraData * f_data) -> bool {
         //data
-        srand(time(NULL));
-        std::vector<bool> answerString;
-        std::ofstream maxCutCircuitQasm;
-        std::ofstream maxCutAnswer(f_data->outputFile);
-        maxCutAnswer<<f_data->fileName<<std::endl;
-        double currentProb(1.0);
-
-        maxCutCircuitQasm.open("input/tempMaxCut.qasm");
-        maxCutCircuitQasm<<f_data->numQubits<<std::endl;
-        outputInitialPlusStateToFile(maxCutCircuitQasm,f_data->numQubits);
-        applyU_CsThenU_Bs(f_data->pairs,static_cast<ExtraData *>(f_data)->p,betas_gammas,f_data->numQubits,maxCutCircuitQasm);
-        maxCutCircuitQasm.close();
-
-        for(int i=0; i<f_data->numQubits; i++)
+        std::vector<Gate> maxCutCircuit;
+        addInitialPlusState(maxCutCircuit,f_data->numQubits);
+        applyU_CsThenU_Bs(f_data->pairs,static_cast<ExtraData *>(f_data)->p,betas_gammas,f_data->numQubits,maxCutCircuit);
+
+        //the answer gives each qubit in turn its more likely value given the bits before it, or (if NUM_FINAL_STRING_SAMPLES
+        //is set) is the best cut of that many bitstrings drawn from the final state - the marginals are cached either way
+        ContractionTools p (std::make_shared<Network>(f_data->numQubits,maxCutCircuit));
+        std::vector<std::vector<bool>> samples;
+        if(NUM_FINAL_STRING_SAMPLES > 0)
         {
-            std::ofstream measurements("input/measureTest.txt");
-            for(int j=0; j<static_cast<ExtraData *>(f_data)->numQubits; j++)
+            samples = contractionSequence.size()==0 ? p.SampleBitstrings(NUM_FINAL_STRING_SAMPLES, Stochastic)
+                                                    : p.SampleBitstrings(NUM_FINAL_STRING_SAMPLES, contractionSequence);
+        }
+        else
+        {
+            std::vector<bool> mostLikely(contractionSequence.size()==0 ? p.MostLikelyBitstring(Stochastic)
+                                                                       : p.MostLikelyBitstring(contractionSequence));
+            if(!mostLikely.empty())
             {
-                if(j<answerString.size())
-                {
-                    if(answerString[j])
-                    {
-                        measurements <<"1 ";
-                    }
-                    else
-                    {
-                        measurements<<"0 ";
-                    }
-                }
-                else if(j==i)
-                {
-                    measurements<<"0 ";
-                }
-                else
+                samples.push_back(mostLikely);
+            }
+        }
+        if(samples.empty())
+        {
+            std::cout<<"Failed to contract the final state"<<std::endl;
+            return false;
+        }
+
+        std::vector<bool> answerString;
+        int cutEdgeCount(-1);
+        for(auto& sample: samples)
+        {
+            int sampleCutEdgeCount(0);
+            std::for_each(f_data->pairs.begin(),f_data->pairs.end(),[&sample,&sampleCutEdgeCount](std::pair<int,int> edge){
+                if(sample[edge.first]!=sample[edge.second])
                 {
-                    measurements<<"T ";
+                    sampleCutEdgeCount++;
                 }
-            }
-            measurements.close();
-            ContractionTools p ("input/tempMaxCut.qasm","input/measureTest.txt");
-            if(contractionSequence.size()==0)
-            {
-                p.Contract(Stochastic);
-            }
-            else
+            });
+            if(sampleCutEdgeCount>cutEdgeCount)
             {
-                p.ContractGivenSequence(contractionSequence);
+                cutEdgeCount = sampleCutEdgeCount;
+                answerString = sample;
             }
-            double probNextGivenPrev(p.GetFinalVal().real()/currentProb);
-                if (probNextGivenPrev > 0.5)
-                {
-                    currentProb *= probNextGivenPrev;
-                    answerString.push_back(false);
-                }
-                else if (probNextGivenPrev < 0.5)
-                {
-                    currentProb *= (1.0-probNextGivenPrev);
-                    answerString.push_back(true);
-                }
-                else
-                {
-                    int r = rand() % 2;
-                    if (r == 1) {
-                        answerString.push_back(true);
-                    } else {
-                        answerString.push_back(false);
-                    }
-                    currentProb*=0.5;
-                }
-
-
         }
-        int counter(0);
+        std::ofstream maxCutAnswer(f_data->outputFile);
+        maxCutAnswer<<f_data->fileName<<std::endl;
         std::for_each(answerString.begin(),answerString.end(),[&maxCutAnswer](bool b){
            maxCutAnswer<<b<<" ";
         });
 
-        int cutEdgeCount(0);
-        std::for_each(f_data->pairs.begin(),f_data->pairs.end(),[&answerString,&cutEdgeCount,&f_data](std::pair<int,int> edge){
-            if(answerString[edge.first]!=answerString[edge.second])
-            {
-                cutEdgeCount++;
-            }
-        });
         maxCutAnswer<<std::endl<<"Cut edges: "<<cutEdgeCount<<"/"<<f_data->numQubits*3/2<<std::endl;
         maxCutAnswer<<"Time elapsed: "<<z.getElapsed()<<std::endl;
         maxCutAnswer.close();
+        return true;
+    };
 
 
+    return calculateFinalString(gAndB,&e);
+}
+
+//this function returns the expected number of cut edges for the given angles, contracting the light cone circuit of each
+//class of isomorphic edges, and fills in its gradient if one is asked for
+double tensorNetworkObjective(const std::vector<double>& betas_gammas, std::vector<double>& grad, ExtraData *e)
+{
+    //bind the angles and contract each light cone class's circuit along its planned sequence, differentiating it if
+    //asked to. The classes are independent, so a few threads each take the next one that is left
+    int numEdges(e->edgeCircuits.size());
+    std::vector<double> edgeValues(numEdges);
+    std::vector<std::vector<std::complex<double>>> edgeGradients(numEdges);
+    std::atomic<int> nextEdge(0);
+    std::exception_ptr failure;
+    std::mutex failureLock;
+    auto worker = [&]() {
+        for(int counter = nextEdge++; counter < numEdges; counter = nextEdge++)
+        {
+            try {
+                //bind a copy, so that several optimizations can share the circuits
+                std::shared_ptr<Network> edgeCircuit(e->edgeCircuits[counter]->Clone());
+                edgeCircuit->BindParameters(betas_gammas);
+                ContractionTools qComputer(edgeCircuit);
+                if(grad.empty())
+                {
+                    qComputer.ContractGivenSequence(e->edgeSequences[counter]);
+                }
+                else
+                {
+                    edgeGradients[counter] = qComputer.Gradient(e->edgeSequences[counter]);
+                }
+                edgeValues[counter] = 0.5 * (1.0 - qComputer.GetFinalVal().real());
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(failureLock);
+                failure = std::current_exception();
+            }
+        }
     };
+    std::vector<std::thread> threads;
+    for(int i = 1; i < std::min(e->numObjectiveThreads, numEdges); ++i)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for(auto& t: threads)
+    {
+        t.join();
+    }
+    if(failure)
+    {
+        std::rethrow_exception(failure);
+    }
+
+    //sum in class order, weighted by the number of edges in each class, so the value does not depend on the threads
+    double f_pVal(0.0);
+    std::fill(grad.begin(), grad.end(), 0.0);
+    for(int counter = 0; counter < numEdges; ++counter)
+    {
+        int multiplicity(e->lightConeMultiplicities[counter]);
+        f_pVal += multiplicity * edgeValues[counter];
+        for(int k = 0; k < grad.size() && k < edgeGradients[counter].size(); ++k)
+        {
+            grad[k] -= 0.5 * multiplicity * edgeGradients[counter][k].real();
+        }
+    }
+    return f_pVal;
+}
 
+//this function returns the expected number of cut edges for p=1 angles in closed form, and fills in its gradient if one
+//is asked for
+double closedFormP1Objective(const std::vector<double>& betas_gammas, std::vector<double>& grad, ExtraData *e)
+{
+    double f_pVal(0.0);
+    std::fill(grad.begin(), grad.end(), 0.0);
+    for(const auto& neighbourhood: e->edgeNeighbourhoods)
+    {
+        double dBeta, dGamma;
+        f_pVal += closedFormP1EdgeCut(betas_gammas[0], betas_gammas[1], neighbourhood[0], neighbourhood[1], neighbourhood[2],
+                                      dBeta, dGamma);
+        if(!grad.empty())
+        {
+            grad[0] += dBeta;
+            grad[1] += dGamma;
+        }
+    }
+    return f_pVal;
+}
 
-    calculateFinalString(gAndB,&e);
+//this function gets the objective of a given p ready to evaluate: the edge counts of the closed form for p=1, and the
+//planned light cone circuit of every class of isomorphic edges otherwise (and for the p=1 check). Returns false if the
+//closed form does not match the tensor network
+bool prepareObjective(ExtraData& e)
+{
+    if(e.p == 1)
+    {
+        e.CountEdgeNeighbourhoods();
+    }
 
+    //build the parameterized light cone circuit of every class of isomorphic edges once - the objective function only
+    //rebinds the angles
+    if(e.p != 1 || CHECK_CLOSED_FORM_P1)
+    {
+        e.GroupIsomorphicLightCones();
+        std::cout<<e.pairs.size()<<" edges in "<<e.lightConeRepresentatives.size()<<" light cone classes"<<std::endl;
+        for(int counter: e.lightConeRepresentatives)
+        {
+            std::vector<Gate> maxCutCircuit;
+            int numQubits(e.qubitsNeeded[counter]);
+            addInitialPlusState(maxCutCircuit, numQubits);
+            applyParameterizedU_CsThenU_Bs(e.realIterations[counter], e.p, numQubits, maxCutCircuit);
+            e.edgeCircuits.push_back(std::make_shared<Network>(numQubits, maxCutCircuit, std::vector<char>{'Z', 'Z'}));
+            ContractionTools planner(e.edgeCircuits.back()->Clone());
+            e.edgeSequences.push_back(planner.PlanContractionSequence(Stochastic));
+        }
+    }
 
+    //spot check the closed form (value and gradient) against the tensor network
+    if(e.p == 1 && CHECK_CLOSED_FORM_P1)
+    {
+        std::vector<double> betas_gammas{0.392699, 0.785399};
+        std::vector<double> closedFormGrad(2), tensorNetworkGrad(2);
+        double closedForm(closedFormP1Objective(betas_gammas, closedFormGrad, &e));
+        double tensorNetwork(tensorNetworkObjective(betas_gammas, tensorNetworkGrad, &e));
+        if(std::abs(closedForm - tensorNetwork) > CLOSED_FORM_P1_TOLERANCE * e.pairs.size() ||
+           std::abs(closedFormGrad[0] - tensorNetworkGrad[0]) > CLOSED_FORM_P1_TOLERANCE * e.pairs.size() ||
+           std::abs(closedFormGrad[1] - tensorNetworkGrad[1]) > CLOSED_FORM_P1_TOLERANCE * e.pairs.size())
+        {
+            std::cout<<"Closed-form p=1 objective "<<closedForm<<" does not match the tensor network "<<tensorNetwork<<std::endl;
+            return false;
+        }
+    }
+    return true;
+}
 
+//the objective maximized by nlopt - the expected number of cut edges
+double maxcutObjective(const std::vector<double>& betas_gammas, std::vector<double>& grad, void * f_data)
+{
+    ExtraData *e = static_cast<ExtraData *>(f_data);
+    //p=1 has a closed form, the tensor network is only needed for p>=2
+    return e->p == 1 ? closedFormP1Objective(betas_gammas, grad, e) : tensorNetworkObjective(betas_gammas, grad, e);
 }
 
-//finds the optimal gammas and betas, and prints them to tempGammasAndBetas.txt
-//will occasionally cause a memory error (something to do with the optimization function), so you just have to run it again
+//this function runs an optimization from each of the starting angles at the same time, sharing the planned objective,
+//and returns the best angles found (empty if every run failed). The best value is written to bestValue
+std::vector<double> optimizeFromStarts(ExtraData& e, const std::vector<std::vector<double>>& starts, double& bestValue)
+{
+    int numStarts(starts.size());
+    std::vector<std::vector<double>> results(numStarts);
+    std::vector<double> values(numStarts, -1.0);
+    //the hardware threads are split between the runs, each run contracting light cones on its share - every run starts its
+    //own objective threads (see tensorNetworkObjective), there is no pool shared between the runs
+    e.numObjectiveThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / std::max(1, numStarts));
+    auto run = [&e, &starts, &results, &values](int start) {
+        try {
+            nlopt::opt optimization(nlopt::LD_LBFGS, 2 * e.p);
+            optimization.set_max_objective(maxcutObjective, &e);
+            optimization.set_xtol_rel(1e-6);
+            std::vector<double> betas_gammas(starts[start]);
+            double value;
+            optimization.optimize(betas_gammas, value);
+            results[start] = betas_gammas;
+            values[start] = value;
+        }
+        catch (std::exception &error) {
+            std::cout << "Optimization from start " << start << " failed: " << error.what() << std::endl;
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int start = 1; start < numStarts; ++start)
+    {
+        threads.push_back(std::thread(run, start));
+    }
+    run(0);
+    for(auto& t: threads)
+    {
+        t.join();
+    }
 
-void maxcutGetOptimalAngles(std::string& graphFilePath, int p, const std::string& outputPath){
+    std::vector<double> best;
+    bestValue = -1.0;
+    for(int start = 0; start < numStarts; ++start)
+    {
+        if(!results[start].empty() && values[start] > bestValue)
+        {
+            bestValue = values[start];
+            best = results[start];
+        }
+    }
+    return best;
+}
+
+//this function interpolates optimal angles for p to starting angles for p+1 (Zhou et al., PRX 10, 021067): the betas and
+//the gammas are each read as a schedule over the layers and resampled at one more point
+std::vector<double> interpolateAngles(const std::vector<double>& betas_gammas)
+{
+    int p(betas_gammas.size() / 2);
+    std::vector<double> interpolated(2 * (p + 1));
+    for(int half = 0; half < 2; ++half)
+    {
+        for(int i = 0; i <= p; ++i)
+        {
+            double previous(i > 0 ? betas_gammas[half * p + i - 1] : 0.0);
+            double current(i < p ? betas_gammas[half * p + i] : 0.0);
+            interpolated[half * (p + 1) + i] = (static_cast<double>(i) / p) * previous + (static_cast<double>(p - i) / p) * current;
+        }
+    }
+    return interpolated;
+}
+
+//finds the optimal gammas and betas, and prints them to the output file. The angles are optimized from NUM_ANGLE_STARTS
+//starts at once: the usual fixed angles and random ones. With WARM_START_QAOA, each p up to the one asked for is optimized
+//in turn, starting from the angles interpolated from the best ones of the previous p. Returns false (and writes no file)
+//if the objective cannot be prepared or every optimization fails. The random starts are drawn from the given seed, so a run
+//can be repeated
+
+bool maxcutGetOptimalAngles(std::string& graphFilePath, int p, const std::string& outputPath, const unsigned int seed){
     //the goal of this main class is to run the maxcut algorithm on a graph supplied in the command line arguments
     //the class will use qaoa to solve the maxcut problem, outputting a qasm circuit and simulating it for each iteration of of the maximization algorithm
     //the user will specify the "p" and the graph file in the command line, and this class will run a maxcut simulation based on the graph
@@ -152,85 +325,170 @@ void maxcutGetOptimalAngles(std::string& graphFilePath, int p, const std::string
 
     Timer z;
     z.start();
-    std::vector<double> betas_gammas0(2 * p);
-    std::fill(betas_gammas0.begin(), betas_gammas0.begin() + betas_gammas0.size() / 2, 0.392699);
-    std::fill(betas_gammas0.begin() + betas_gammas0.size() / 2, betas_gammas0.end(), 0.785399);
-    ExtraData e(p,graphFilePath.c_str());
-    e.outputFile = outputPath;
-
-
-    auto F_p = [](const std::vector<double>& betas_gammas,std::vector<double>& grad, void * f_data)->double {
-        //data
-        std::ofstream maxCutCircuitQasm;
-        std::ofstream tempGammasAndBetas(static_cast<ExtraData *>(f_data)->outputFile);
-
-
-        //initialize and apply functions
-        double f_pVal(0.0);
-        int counter(0);
-        std::for_each(static_cast<ExtraData *>(f_data)->pairs.begin(),static_cast<ExtraData *>(f_data)->pairs.end(), [&maxCutCircuitQasm, &f_pVal, f_data, &betas_gammas, &counter](std::pair<int,int> tem) {
-            maxCutCircuitQasm.open("input/tempMaxCut.qasm");
-            std::ofstream measurements("input/measureTest.txt");
-            int numQubits(static_cast<ExtraData *>(f_data)->qubitsNeeded[counter]);
-            maxCutCircuitQasm << numQubits << std::endl;
-            outputInitialPlusStateToFile(maxCutCircuitQasm, numQubits);
-            applyU_CsThenU_Bs(static_cast<ExtraData *>(f_data)->realIterations[counter], static_cast<ExtraData *>(f_data)->p, betas_gammas,numQubits,
-                              maxCutCircuitQasm);
-            for (int i = 0; i < numQubits; i++) {
-                if (i == 0 || i == 1)
-                {
-                    measurements << "Z ";
-                }
-                else
-                {
-                    measurements<<"T ";
-                }
-            }
-            measurements.close();
-            maxCutCircuitQasm.close();
-
-            ContractionTools qComputer("input/tempMaxCut.qasm", "input/measureTest.txt");
-            qComputer.Contract(Stochastic);
-
-
-            f_pVal += 0.5 * (1.0 - qComputer.GetFinalVal().real());
-            ++counter;
-        });
-        for(const auto& gORb: betas_gammas) {
-            tempGammasAndBetas<<gORb<<" ";
+    std::mt19937 generator(seed);
+    std::cout<<"Random starting angles seeded with "<<seed<<std::endl;
+    std::uniform_real_distribution<double> betaDistribution(0.0, PI / 2);
+    std::uniform_real_distribution<double> gammaDistribution(0.0, PI);
+
+    std::vector<double> best{0.392699, 0.785399};
+    double bestValue(0.0);
+    for(int level = WARM_START_QAOA ? 1 : p; level <= p; ++level)
+    {
+        std::vector<std::vector<double>> starts;
+        if(level == 1)
+        {
+            starts.push_back({0.392699, 0.785399});
+        }
+        else if(WARM_START_QAOA)
+        {
+            starts.push_back(interpolateAngles(best));
+        }
+        else
+        {
+            //no warm start - the usual fixed angles in every layer
+            std::vector<double> betas_gammas0(2 * level);
+            std::fill(betas_gammas0.begin(), betas_gammas0.begin() + level, 0.392699);
+            std::fill(betas_gammas0.begin() + level, betas_gammas0.end(), 0.785399);
+            starts.push_back(betas_gammas0);
+        }
+        while(starts.size() < NUM_ANGLE_STARTS)
+        {
+            std::vector<double> betas_gammas0(2 * level);
+            std::generate(betas_gammas0.begin(), betas_gammas0.begin() + level, [&](){ return betaDistribution(generator); });
+            std::generate(betas_gammas0.begin() + level, betas_gammas0.end(), [&](){ return gammaDistribution(generator); });
+            starts.push_back(betas_gammas0);
         }
-        tempGammasAndBetas.close();
-        return f_pVal;
-    };
-
 
+        ExtraData e(level, graphFilePath.c_str());
+        if(!prepareObjective(e))
+        {
+            return false;
+        }
+        std::vector<double> levelBest(optimizeFromStarts(e, starts, bestValue));
+        if(levelBest.empty())
+        {
+            std::cout<<"Every optimization failed for p="<<level<<std::endl;
+            std::cout<<"Took "<<z.getElapsed()<<" seconds"<<std::endl;
+            return false;
+        }
+        best = levelBest;
+        std::cout<<"p="<<level<<" expected cut edges: "<<bestValue<<std::endl;
+    }
 
-    //optimize(maximize)
-    try {
+    std::ofstream tempGammasAndBetas(outputPath);
+    for(const auto& gORb: best) {
+        tempGammasAndBetas<<gORb<<" ";
+    }
+    tempGammasAndBetas.close();
+    std::cout<<"Took "<<z.getElapsed()<<" seconds"<<std::endl;
+    return true;
+}
 
-         nlopt::opt optimization(nlopt::LN_COBYLA, 2 * p);
-         optimization.set_max_objective(F_p, &e);
-         std::vector<double> finalBetas_Gammas(optimization.optimize(betas_gammas0));
-        std::cout<<"Took "<<z.getElapsed()<<" seconds"<<std::endl;
+//this function writes the objective (expected cut edges) on a grid of angles to a CSV file, with rows "beta,gamma,value".
+//The same beta and gamma are used in every layer, beta going over [0, pi/2) and gamma over [0, pi) in pointsPerAngle steps.
+//The objective is prepared once; for p>=2 each light cone class contracts chunks of LANDSCAPE_BATCH_SIZE grid points in one
+//batched pass, the (class, chunk) pairs spread over the hardware threads
+void maxcutScanLandscape(std::string& graphFilePath, int p, const std::string& outputPath, const int pointsPerAngle)
+{
+    Timer z;
+    z.start();
+    ExtraData e(p, graphFilePath.c_str());
+    if(pointsPerAngle < 1 || !prepareObjective(e))
+    {
+        return;
+    }
+    std::vector<std::vector<double>> grid;
+    for(int i = 0; i < pointsPerAngle; ++i)
+    {
+        for(int j = 0; j < pointsPerAngle; ++j)
+        {
+            std::vector<double> betas_gammas(2 * p);
+            std::fill(betas_gammas.begin(), betas_gammas.begin() + p, i * (PI / 2) / pointsPerAngle);
+            std::fill(betas_gammas.begin() + p, betas_gammas.end(), j * PI / pointsPerAngle);
+            grid.push_back(betas_gammas);
+        }
+    }
 
+    std::vector<double> values(grid.size(), 0.0);
+    if(p == 1)
+    {
+        std::vector<double> noGrad;
+        for(int point = 0; point < grid.size(); ++point)
+        {
+            values[point] = closedFormP1Objective(grid[point], noGrad, &e);
+        }
     }
-    catch (std::runtime_error &error) {
-        std::cout << error.what() << std::endl;
-        std::cout<<"Took "<<z.getElapsed()<<" seconds"<<std::endl;
-        return;
+    else
+    {
+        int numClasses(e.edgeCircuits.size());
+        int numChunks((grid.size() + LANDSCAPE_BATCH_SIZE - 1) / LANDSCAPE_BATCH_SIZE);
+        int numUnits(numClasses * numChunks);
+        std::vector<std::vector<std::complex<double>>> classValues(numUnits);
+        std::atomic<int> nextUnit(0);
+        std::exception_ptr failure;
+        std::mutex failureLock;
+        auto worker = [&]() {
+            for(int unit = nextUnit++; unit < numUnits; unit = nextUnit++)
+            {
+                try {
+                    int lightConeClass(unit / numChunks);
+                    int chunk(unit % numChunks);
+                    std::vector<std::vector<double>> bindings(grid.begin() + chunk * LANDSCAPE_BATCH_SIZE,
+                                                              grid.begin() + std::min<int>((chunk + 1) * LANDSCAPE_BATCH_SIZE, grid.size()));
+                    ContractionTools qComputer(e.edgeCircuits[lightConeClass]);
+                    classValues[unit] = qComputer.ContractBatch(bindings, e.edgeSequences[lightConeClass]);
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(failureLock);
+                    failure = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for(int i = 1; i < std::min(static_cast<int>(std::thread::hardware_concurrency()), numUnits); ++i)
+        {
+            threads.push_back(std::thread(worker));
+        }
+        worker();
+        for(auto& t: threads)
+        {
+            t.join();
+        }
+        if(failure)
+        {
+            std::rethrow_exception(failure);
+        }
+        //sum in class order, weighted by the number of edges in each class
+        for(int unit = 0; unit < numUnits; ++unit)
+        {
+            int multiplicity(e.lightConeMultiplicities[unit / numChunks]);
+            for(int k = 0; k < classValues[unit].size(); ++k)
+            {
+                values[(unit % numChunks) * LANDSCAPE_BATCH_SIZE + k] += multiplicity * 0.5 * (1.0 - classValues[unit][k].real());
+            }
+        }
+    }
+
+    std::ofstream landscape(outputPath);
+    landscape<<std::setprecision(10);
+    for(int point = 0; point < grid.size(); ++point)
+    {
+        landscape<<grid[point][0]<<","<<grid[point][p]<<","<<values[point]<<"\n";
     }
+    landscape.close();
+    std::cout<<"Took "<<z.getElapsed()<<" seconds"<<std::endl;
 }
 
 //main process
 
-//command line arguments: <GraphFile Path> <p value> <0 for getAngles, 1 for final cut> <file path to either input angle file (if 1) or output angle file (if 0)> <seconds to preprocess for>
+//command line arguments: <GraphFile Path> <p value> <0 for getAngles, 1 for final cut, 2 for both, 3 for landscape> <file path to either input angle file (if 1) or output angle file (if 0) or landscape file (if 3)> <seconds to preprocess for, or points per angle (if 3), or seed of the starting angles (if 0)> <seed of the starting angles (if 2)>
 int main(int argc, char *argv[]) {
     if(argc<5)
     {
         std::cout<<"Not enough arguments"<<std::endl;
-        std::cout<<"arguments: <GraphFile Path> <p value> <0 for getAngles> <file path to output angle file>\n";
+        std::cout<<"arguments: <GraphFile Path> <p value> <0 for getAngles> <file path to output angle file> <seed of the starting angles (optional)>\n";
         std::cout<<"OR arguments: <GraphFile Path> <p value> <1 for final cut> <file path to input angle file> <file path to output answer file> <seconds to preprocess for (optional)>\n";
-        std::cout<<"OR arguments: <GraphFile Path> <p value> <2 for both> <file path to output answer file> <seconds to preprocess for (optional)>\n\n";
+        std::cout<<"OR arguments: <GraphFile Path> <p value> <2 for both> <file path to output answer file> <seconds to preprocess for (optional)> <seed of the starting angles (optional)>\n";
+        std::cout<<"OR arguments: <GraphFile Path> <p value> <3 for landscape> <file path to output CSV file> <points per angle (optional)>\n\n";
         return -1;
     }
     int pVal = atoi(argv[2]);
@@ -242,16 +500,24 @@ int main(int argc, char *argv[]) {
     }
     std::string graphFilePath(argv[1]);
     mkdir("output",0755);
-    mkdir("input",0755);
     int procSec = 60;
     if(anglesOrFinalCut ==1 && argc ==7)
     {
         procSec = atoi(argv[6]);
     }
-    if(anglesOrFinalCut==2 && argc ==6)
+    if(anglesOrFinalCut==2 && argc >=6)
     {
         procSec = atoi(argv[5]);
     }
+    unsigned int angleSeed = DEFAULT_ANGLE_SEED;
+    if(anglesOrFinalCut==0 && argc ==6)
+    {
+        angleSeed = strtoul(argv[5], nullptr, 10);
+    }
+    if(anglesOrFinalCut==2 && argc ==7)
+    {
+        angleSeed = strtoul(argv[6], nullptr, 10);
+    }
 
     //this part finds the opt string from gammas and betas
 
@@ -266,17 +532,18 @@ int main(int argc, char *argv[]) {
             gammasAndBetas.push_back(z);
         }
         ExtraData e(pVal, graphFilePath.c_str());
-        std::ofstream maxCutCircuitQasm("input/tempMaxCut.qasm");
-        maxCutCircuitQasm << e.numQubits << std::endl;
-        outputInitialPlusStateToFile(maxCutCircuitQasm, e.numQubits);
-        applyU_CsThenU_Bs(e.pairs, pVal, gammasAndBetas, e.numQubits, maxCutCircuitQasm);
-        maxCutCircuitQasm.close();
+        std::vector<Gate> maxCutCircuit;
+        addInitialPlusState(maxCutCircuit, e.numQubits);
+        applyU_CsThenU_Bs(e.pairs, pVal, gammasAndBetas, e.numQubits, maxCutCircuit);
         bool success(false);
         std::vector<std::pair<int, int>> optContract;
-        success = preProcess("input/tempMaxCut.qasm", optContract, procSec);
+        success = preProcess(std::make_shared<Network>(e.numQubits, maxCutCircuit), optContract, procSec);
         if (success)
         {
-            maxcutGetFinalString(graphFilePath, pVal, optContract, gammasAndBetas, outfilePath);
+            if(!maxcutGetFinalString(graphFilePath, pVal, optContract, gammasAndBetas, outfilePath))
+            {
+                return -1;
+            }
         }
         else
         {
@@ -287,12 +554,26 @@ int main(int argc, char *argv[]) {
     else if(anglesOrFinalCut==0)
     {
         std::string outputPath(argv[4]);
-        maxcutGetOptimalAngles(graphFilePath, pVal,outputPath);
+        if(!maxcutGetOptimalAngles(graphFilePath, pVal,outputPath,angleSeed))
+        {
+            std::cout<<"Angle Optimization Failed"<<std::endl;
+            return -1;
+        }
+    }
+    else if(anglesOrFinalCut==3)
+    {
+        std::string outputPath(argv[4]);
+        int pointsPerAngle(argc > 5 ? atoi(argv[5]) : DEFAULT_LANDSCAPE_POINTS);
+        maxcutScanLandscape(graphFilePath, pVal, outputPath, pointsPerAngle);
     }
     else if(anglesOrFinalCut==2)
     {
         std::string outfilePath(argv[4]);
-        maxcutGetOptimalAngles(graphFilePath, pVal,"tempAngles.txt");
+        if(!maxcutGetOptimalAngles(graphFilePath, pVal,"tempAngles.txt",angleSeed))
+        {
+            std::cout<<"Angle Optimization Failed"<<std::endl;
+            return -1;
+        }
         std::ifstream inAngles("tempAngles.txt");
         std::vector<double> gammasAndBetas;
         for(int i=0; i<2*pVal;i++)
@@ -304,17 +585,18 @@ int main(int argc, char *argv[]) {
         inAngles.close();
         remove("tempAngles.txt");
         ExtraData e(pVal, graphFilePath.c_str());
-        std::ofstream maxCutCircuitQasm("input/tempMaxCut.qasm");
-        maxCutCircuitQasm << e.numQubits << std::endl;
-        outputInitialPlusStateToFile(maxCutCircuitQasm, e.numQubits);
-        applyU_CsThenU_Bs(e.pairs, pVal, gammasAndBetas, e.numQubits, maxCutCircuitQasm);
-        maxCutCircuitQasm.close();
+        std::vector<Gate> maxCutCircuit;
+        addInitialPlusState(maxCutCircuit, e.numQubits);
+        applyU_CsThenU_Bs(e.pairs, pVal, gammasAndBetas, e.numQubits, maxCutCircuit);
         bool success(false);
         std::vector<std::pair<int, int>> optContract;
-        success = preProcess("input/tempMaxCut.qasm", optContract, procSec);
+        success = preProcess(std::make_shared<Network>(e.numQubits, maxCutCircuit), optContract, procSec);
         if (success)
         {
-            maxcutGetFinalString(graphFilePath, pVal, optContract, gammasAndBetas,outfilePath);
+            if(!maxcutGetFinalString(graphFilePath, pVal, optContract, gammasAndBetas,outfilePath))
+            {
+                return -1;
+            }
         }
         else
         {
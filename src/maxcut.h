@@ -20,12 +20,25 @@ See the License for the specific language governing permissions and
 
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <map>
+#include <numeric>
+#include <functional>
+#include <cmath>
 #include "Timer.h"
 #include "ContractionTools.h"
 #include "preprocess.h"
 #include <nlopt.hpp>
 #include <sys/stat.h>
 
+#define NUM_FINAL_STRING_SAMPLES 0 // set above 0 to answer with the best of this many bitstrings drawn from the final state instead of the most likely bits
+#define NUM_ANGLE_STARTS 4 // angle optimizations run at the same time from different starting angles
+#define DEFAULT_ANGLE_SEED 12345 // seed of the random starting angles, unless one is given on the command line
+#define WARM_START_QAOA 0 // set to 1 to optimize p=1, 2, ... in turn, starting each from the angles interpolated from the one before
+#define DEFAULT_LANDSCAPE_POINTS 100 // grid points along each angle of a landscape scan
+#define LANDSCAPE_BATCH_SIZE 64 // grid points contracted together in one batched pass of a landscape scan
+#define CHECK_CLOSED_FORM_P1 0 // set to 1 to compare the closed-form p=1 objective with the tensor network before optimizing
+#define CLOSED_FORM_P1_TOLERANCE 1e-6 // largest difference allowed by that check
 
 
 struct ExtraData
@@ -37,12 +50,20 @@ struct ExtraData
     std::vector<std::vector<int>> adjacencyLists;
     std::vector<int> qubitsNeeded;
     std::string outputFile;
+    int numObjectiveThreads = 1; //threads each evaluation of the objective contracts light cones on
     int numQubits;
     int p;
     std::vector<std::vector<std::pair<int,int>>> iterations; //first pair in the list is the measurement to perform
     std::vector<std::vector<std::pair<int,int>>> realIterations;
+    std::vector<int> lightConeRepresentatives; //an edge of each class of edges whose light cones are isomorphic
+    std::vector<int> lightConeMultiplicities; //the number of edges in each class
+    std::vector<std::shared_ptr<qtorch::Network>> edgeCircuits; //parameterized light cone circuit for each class, measuring ZZ on qubits 0 and 1
+    std::vector<std::vector<std::pair<int,int>>> edgeSequences; //contraction sequence planned once for each class's circuit
+    std::vector<std::vector<int>> edgeNeighbourhoods; //for each edge: the other neighbours of each of its vertices, and the triangles on it (used by the closed-form p=1 objective)
     void ReadInData();
     void PopulateIterations();
+    void GroupIsomorphicLightCones();
+    void CountEdgeNeighbourhoods();
     void PopulateIterationsHelper (int counter,
                                               std::vector<int>& workingVerticesList,
                                               std::vector<bool>& newWorkingVertices,
@@ -116,8 +137,10 @@ void ExtraData::PopulateIterations()
         workingVertices.reserve(numQubits);
         workingVertices.push_back(currentPair.first);
         workingVertices.push_back(currentPair.second);
+        //the measured qubits are 0 and 1
         mapToRealIterations[currentPair.first] = 0;
-        qubitsNeeded[placeInIterations]++;
+        mapToRealIterations[currentPair.second] = 1;
+        qubitsNeeded[placeInIterations] += 2;
         std::vector<bool>isNewWorking(numQubits,false);
         std::vector<bool>wasChecked(numQubits, false);
         std::vector<bool>isAlreadyInWorkingNodes(numQubits,false);
@@ -133,6 +156,68 @@ void ExtraData::PopulateIterations()
     }
 };
 
+std::vector<std::vector<int>> lightConeAdjacency(const std::vector<std::pair<int,int>>& edges, const int numQubits);
+bool isomorphicLightCones(const std::vector<std::vector<int>>& a, const std::vector<std::vector<int>>& b);
+
+//this function groups the edges whose light cone circuits are the same up to relabeling the qubits - they have the same
+//expectation value for any angles, so each class only needs to be contracted once and weighted by its number of edges.
+//The U_C gates of a layer commute, so a light cone circuit only depends on its graph with the measured qubits marked
+void ExtraData::GroupIsomorphicLightCones()
+{
+    lightConeRepresentatives.clear();
+    lightConeMultiplicities.clear();
+    //graphs with different invariants (size, degrees) cannot be isomorphic, so only classes with the same ones are checked
+    std::map<std::vector<int>, std::vector<int>> classesByInvariant;
+    std::vector<std::vector<std::vector<int>>> classGraphs;
+    for(int counter = 0; counter < realIterations.size(); ++counter)
+    {
+        std::vector<std::vector<int>> graph(lightConeAdjacency(realIterations[counter], qubitsNeeded[counter]));
+        std::vector<int> degrees;
+        for(const auto& row: graph)
+        {
+            degrees.push_back(std::accumulate(row.begin(), row.end(), 0));
+        }
+        std::vector<int> invariant{qubitsNeeded[counter], std::min(degrees[0], degrees[1]), std::max(degrees[0], degrees[1])};
+        std::sort(degrees.begin(), degrees.end());
+        invariant.insert(invariant.end(), degrees.begin(), degrees.end());
+
+        std::vector<int>& candidates = classesByInvariant[invariant];
+        auto found = std::find_if(candidates.begin(), candidates.end(), [&classGraphs, &graph](int lightConeClass){
+            return isomorphicLightCones(classGraphs[lightConeClass], graph);
+        });
+        if(found != candidates.end())
+        {
+            lightConeMultiplicities[*found]++;
+            continue;
+        }
+        candidates.push_back(classGraphs.size());
+        classGraphs.push_back(graph);
+        lightConeRepresentatives.push_back(counter);
+        lightConeMultiplicities.push_back(1);
+    }
+}
+
+//this function counts, for each edge, the neighbours of its two vertices other than each other and the triangles the edge
+//is on - all the closed-form p=1 expectation needs to know about the graph
+void ExtraData::CountEdgeNeighbourhoods()
+{
+    edgeNeighbourhoods.clear();
+    for(const auto& edge: pairs)
+    {
+        const std::vector<int>& first = adjacencyLists[edge.first];
+        const std::vector<int>& second = adjacencyLists[edge.second];
+        int triangles(0);
+        for(int vertex: first)
+        {
+            if(vertex != edge.second && std::find(second.begin(), second.end(), vertex) != second.end())
+            {
+                triangles++;
+            }
+        }
+        edgeNeighbourhoods.push_back({static_cast<int>(first.size()) - 1, static_cast<int>(second.size()) - 1, triangles});
+    }
+}
+
 void ExtraData::PopulateIterationsHelper (int counter,
                                           std::vector<int>& workingVerticesList,
                                           std::vector<bool>& newWorkingVertices,
@@ -191,30 +276,28 @@ void ExtraData::PopulateIterationsHelper (int counter,
 //note that pairs are not repeated --> i.e. if there is e 30 45, e 45 30 will not be present
 
 
-void outputInitialPlusStateToFile(std::ofstream& qasmFile, const int numQubits)
+void addInitialPlusState(std::vector<qtorch::Gate>& circuit, const int numQubits)
 {
     for(int i=0; i<numQubits; i++)
     {
-        qasmFile<<"H "<<i<<std::endl;
+        circuit.push_back(qtorch::Gate("H",{i}));
     }
 
 }
 
 
 
-void applyU_CsThenU_Bs(const std::vector<std::pair<int,int>>& objectiveF, const int p, const std::vector<double>& betas_gammas, const int numQubits, std::ofstream& output)
+void applyU_CsThenU_Bs(const std::vector<std::pair<int,int>>& objectiveF, const int p, const std::vector<double>& betas_gammas, const int numQubits, std::vector<qtorch::Gate>& circuit)
 {
     //function definitions
-    auto applyU_C = [](const std::pair<int,int>& toApplyTo, std::ofstream& op, const double gamma)
+    auto applyU_C = [](const std::pair<int,int>& toApplyTo, std::vector<qtorch::Gate>& op, const double gamma)
     {
-        op<<"CNOT "<<toApplyTo.first<<" "<<toApplyTo.second<<std::endl;
-        op<<"Rz "<<-gamma<<" "<<toApplyTo.second<<std::endl;
-        op<<"CNOT "<<toApplyTo.first<<" "<<toApplyTo.second<<std::endl;
+        op.push_back(qtorch::Gate("RZZ",{toApplyTo.first,toApplyTo.second},-gamma));
     };
 
-    auto applyU_B = [](const int toApplyTo, std::ofstream& op, const double beta)
+    auto applyU_B = [](const int toApplyTo, std::vector<qtorch::Gate>& op, const double beta)
     {
-        op<<"Rx "<<beta*2.0<<" "<<toApplyTo<<std::endl;
+        op.push_back(qtorch::Gate("Rx",{toApplyTo},beta*2.0));
     };
 
 
@@ -223,12 +306,147 @@ void applyU_CsThenU_Bs(const std::vector<std::pair<int,int>>& objectiveF, const
 
         for(auto& tempPair: objectiveF)
         {
-            applyU_C(tempPair,output,betas_gammas[i+p]);
+            applyU_C(tempPair,circuit,betas_gammas[i+p]);
         }
         for (int (j) = 0; (j) < numQubits; ++(j))
         {
-            applyU_B(j,output,betas_gammas[i]);
+            applyU_B(j,circuit,betas_gammas[i]);
         }
     }
 }
 
+//this function adds the same gates as applyU_CsThenU_Bs, but leaves the angles as parameter slots - slot i is beta_i and
+//slot i+p is gamma_i, so the network can be bound to any betas_gammas vector with Network::BindParameters
+void applyParameterizedU_CsThenU_Bs(const std::vector<std::pair<int,int>>& objectiveF, const int p, const int numQubits, std::vector<qtorch::Gate>& circuit)
+{
+    for(int i =0; i<p; i++)
+    {
+        for(auto& tempPair: objectiveF)
+        {
+            qtorch::Gate u_C("RZZ",{tempPair.first,tempPair.second});
+            u_C.parameterSlot = i+p;
+            u_C.parameterScale = -1.0;
+            circuit.push_back(u_C);
+        }
+        for (int j = 0; j < numQubits; ++j)
+        {
+            qtorch::Gate u_B("Rx",{j});
+            u_B.parameterSlot = i;
+            u_B.parameterScale = 2.0;
+            circuit.push_back(u_B);
+        }
+    }
+}
+
+//this function returns the number of U_C gates between each two qubits of a light cone circuit
+std::vector<std::vector<int>> lightConeAdjacency(const std::vector<std::pair<int,int>>& edges, const int numQubits)
+{
+    std::vector<std::vector<int>> graph(numQubits, std::vector<int>(numQubits, 0));
+    for(const auto& edge: edges)
+    {
+        graph[edge.first][edge.second]++;
+        graph[edge.second][edge.first]++;
+    }
+    return graph;
+}
+
+//this function returns whether two light cone graphs are the same up to relabeling the qubits, with the measured qubits
+//0 and 1 going to 0 and 1 (in either order, as ZZ is symmetric). It backtracks over the mappings of the other qubits
+bool isomorphicLightCones(const std::vector<std::vector<int>>& a, const std::vector<std::vector<int>>& b)
+{
+    int numQubits(a.size());
+    if(numQubits != b.size() || numQubits < 2)
+    {
+        return false;
+    }
+    std::vector<int> mapping(numQubits, -1);
+    std::vector<bool> used(numQubits, false);
+    //checks that qubit i of a can go to qubit target of b, given the qubits mapped so far
+    auto consistent = [&](int i, int target)->bool {
+        if(a[i][i] != b[target][target] ||
+           std::accumulate(a[i].begin(), a[i].end(), 0) != std::accumulate(b[target].begin(), b[target].end(), 0))
+        {
+            return false;
+        }
+        for(int j = 0; j < numQubits; ++j)
+        {
+            if(mapping[j] != -1 && a[i][j] != b[target][mapping[j]])
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    std::function<bool(int)> extend = [&](int i)->bool {
+        if(i == numQubits)
+        {
+            return true;
+        }
+        for(int target = 2; target < numQubits; ++target)
+        {
+            if(!used[target] && consistent(i, target))
+            {
+                mapping[i] = target;
+                used[target] = true;
+                if(extend(i + 1))
+                {
+                    return true;
+                }
+                mapping[i] = -1;
+                used[target] = false;
+            }
+        }
+        return false;
+    };
+    for(int first = 0; first < 2; ++first)
+    {
+        std::fill(mapping.begin(), mapping.end(), -1);
+        std::fill(used.begin(), used.end(), false);
+        if(!consistent(0, first))
+        {
+            continue;
+        }
+        mapping[0] = first;
+        used[first] = true;
+        if(!consistent(1, 1 - first))
+        {
+            continue;
+        }
+        mapping[1] = 1 - first;
+        used[1 - first] = true;
+        if(extend(2))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//this function returns the closed-form p=1 expectation of the cut 0.5 * (1 - Z_u Z_v) on an edge, given the other
+//neighbours of u and v and the triangles on the edge (Wang, Hadfield, Jiang and Rieffel, PRA 97, 022304). It also
+//writes the derivatives with respect to beta and gamma
+double closedFormP1EdgeCut(const double beta, const double gamma, const int otherNeighboursU, const int otherNeighboursV,
+                           const int triangles, double& dBeta, double& dGamma)
+{
+    //x^n and its derivative with respect to x, without 0 * inf when n is zero
+    auto power = [](const double x, const int n){ return n == 0 ? 1.0 : std::pow(x, n); };
+    auto powerDerivative = [&power](const double x, const int n){ return n == 0 ? 0.0 : n * power(x, n - 1); };
+
+    double c(std::cos(gamma));
+    double s(std::sin(gamma));
+    double w(std::cos(2.0 * gamma));
+    int exponent(otherNeighboursU + otherNeighboursV - 2 * triangles);
+    double singleTerm(s * (power(c, otherNeighboursU) + power(c, otherNeighboursV)));
+    double pairTerm(power(c, exponent) * (1.0 - power(w, triangles)));
+
+    double singleTermDerivative(c * (power(c, otherNeighboursU) + power(c, otherNeighboursV))
+                                - s * s * (powerDerivative(c, otherNeighboursU) + powerDerivative(c, otherNeighboursV)));
+    double pairTermDerivative(-s * powerDerivative(c, exponent) * (1.0 - power(w, triangles))
+                              + power(c, exponent) * 2.0 * std::sin(2.0 * gamma) * powerDerivative(w, triangles));
+
+    double sin4Beta(std::sin(4.0 * beta));
+    double sin2BetaSquared(std::pow(std::sin(2.0 * beta), 2));
+    dBeta = std::cos(4.0 * beta) * singleTerm - 0.5 * sin4Beta * pairTerm;
+    dGamma = 0.25 * sin4Beta * singleTermDerivative - 0.25 * sin2BetaSquared * pairTermDerivative;
+    return 0.5 + 0.25 * sin4Beta * singleTerm - 0.25 * sin2BetaSquared * pairTerm;
+}
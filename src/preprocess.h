@@ -25,16 +25,16 @@ namespace qtorch {
 
 //the function runs a given circuit until it finds a contraction sequence that runs in <= maxTime seconds
 //it returns true if a sequence is found, else it returns false
-    bool preProcess(const std::string &fileName, std::vector<std::pair<int, int>> &optimalContractionSequence,
-                    const double timeThreshold) {
+    bool preProcess(const std::shared_ptr<Network> &original,
+                    std::vector<std::pair<int, int>> &optimalContractionSequence, const double timeThreshold) {
         maxTime = timeThreshold;
+        //every trial contracts its own clone of the network, so the original is left uncontracted
         for (int i(0); i < 100; i++) {
             double newTime;
             totTimer = Timer();
             totTimer.start();
-            ContractionTools p(fileName, "measureTest.txt");
+            ContractionTools p(original->Clone());
             std::shared_ptr<Network> temp = p.Contract(Stochastic);
-            remove("measureTest.txt");
             newTime = totTimer.getElapsed();
             if (newTime <= timeThreshold) //if sequence is found
             {
@@ -50,4 +50,12 @@ namespace qtorch {
         }
         return false;
     };
+
+//same as above, but parses the circuit from a qasm file
+    bool preProcess(const std::string &fileName, std::vector<std::pair<int, int>> &optimalContractionSequence,
+                    const double timeThreshold) {
+        std::shared_ptr<Network> original = std::make_shared<Network>(fileName, "measureTest.txt");
+        remove("measureTest.txt");
+        return preProcess(original, optimalContractionSequence, timeThreshold);
+    };
 }
\ No newline at end of file
@@ -28,6 +28,8 @@ See the License for the specific language governing permissions and
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
 #include <sys/stat.h>
 #include "Network.h"
 #include "Timer.h"
@@ -48,7 +50,28 @@ bool teleporationTest(std::ofstream& out);
 bool tofolliTest(std::ofstream& out);
 bool randomCircuitsTest(std::ofstream& out);
 bool testUserDefinedSequence (std::ofstream& out);
+bool snapshotTest(std::ofstream& out);
+bool cloneTest(std::ofstream& out);
+bool parameterTest(std::ofstream& out);
+bool builderTest(std::ofstream& out);
+bool sharedTensorTest(std::ofstream& out);
+bool observablesTest(std::ofstream& out);
+bool reducedDensityMatrixTest(std::ofstream& out);
+bool samplerTest(std::ofstream& out);
+bool pauliSumTest(std::ofstream& out);
+bool gradientTest(std::ofstream& out);
+bool batchTest(std::ofstream& out);
+bool incrementalTest(std::ofstream& out);
+bool memoTest(std::ofstream& out);
+bool rzzTest(std::ofstream& out);
+bool hyperedgeTest(std::ofstream& out);
+bool permutationTest(std::ofstream& out);
+bool boundaryTest(std::ofstream& out);
+bool sparseTest(std::ofstream& out);
+bool mixedPrecisionTest(std::ofstream& out);
+bool pauliBasisTest(std::ofstream& out);
 void removeFile(const std::string& filePath);
+std::shared_ptr<Network> loadParameterizedCircuit();
 const std::string generateQASMWithDiffPureInputState(const std::string& origQASMFilePath, const std::vector<bool>& inputState);
 void runTests(const std::string& fileToOutputTo);
 std::vector<std::complex<double>> applySimple2qubitSim(const std::string& gateFile, std::ofstream& out);
@@ -108,6 +131,32 @@ void removeFile(const std::string& filePath)
     system(ss.str().c_str());
 }
 
+//this function returns the parameterized circuit (3 qubits, slots $0 to $2, measurements X Z Y) shared by the gradient,
+//batch and incremental tests. The files it is parsed from are removed again
+std::shared_ptr<Network> loadParameterizedCircuit()
+{
+    std::ofstream generateMeasurement("Samples/measureTest.txt");
+    generateMeasurement<<"X Z Y";
+    generateMeasurement.close();
+    std::ofstream circuit("Samples/tempParameterized.qasm");
+    circuit<<"3\nH 0\nH 1\nRx 2*$0 0\nRy $1 1\nCNOT 0 2\nRz -$0 2\n";
+    circuit<<"CPHASE 0.5*$2 1 2\nPHASE $1 0\nCNOT 2 1\nRx -1*$2 2\n";
+    circuit.close();
+    std::shared_ptr<Network> parameterized;
+    try {
+        parameterized = std::make_shared<Network>("Samples/tempParameterized.qasm", "Samples/measureTest.txt");
+    }
+    catch(...)
+    {
+        removeFile("Samples/measureTest.txt");
+        removeFile("Samples/tempParameterized.qasm");
+        throw;
+    }
+    removeFile("Samples/measureTest.txt");
+    removeFile("Samples/tempParameterized.qasm");
+    return parameterized;
+}
+
 //this function takes in a vector of vectors (matrix) and a vector both by reference, and modifies the vector by multiplying
 //it by the matrix. Does not check for correct dimensions
 template <typename T>
@@ -2003,6 +2052,993 @@ bool unconnectedCircuitsTest(std::ofstream& out)
     
 }
 
+//this function tests saving a parsed and reduced network to a binary snapshot and contracting it after reloading it,
+//both directly and through the ContractionTools file constructor, which accepts a snapshot in place of a qasm file
+//returns true on success or false on failure
+//input ofstream is for printing errors/results
+bool snapshotTest(std::ofstream& out)
+{
+    out<<"Running Snapshot Test"<<std::endl<<std::endl;
+    std::ofstream generateMeasurement("Samples/measureTest.txt");
+    generateMeasurement<<"Y X X Y";
+    generateMeasurement.close();
+    bool passed{true};
+    try {
+        std::shared_ptr<Network> original = std::make_shared<Network>("Samples/test_JW.qasm", "Samples/measureTest.txt");
+        original->ReduceCircuit();
+        original->SaveSnapshot("Samples/temp.qtsnap");
+        int numUncontracted = original->GetUncontractedNodes().size();
+
+        ContractionTools c("Samples/temp.qtsnap", "");
+        for (int i(0); i < 2; ++i) {
+            c.Contract(Stochastic);
+            if (std::abs(c.GetFinalVal().real() + .784044) > .000001 || std::abs(c.GetFinalVal().imag()) > .00001) {
+                out << "Failed snapshot test through ContractionTools, trial: " << i + 1 << std::endl;
+                passed = false;
+            }
+        }
+
+        std::shared_ptr<Network> loaded = std::make_shared<Network>();
+        loaded->LoadSnapshot("Samples/temp.qtsnap");
+        if (loaded->GetUncontractedNodes().size() != numUncontracted || loaded->GetNumQubits() != 4) {
+            out << "Failed snapshot topology test" << std::endl;
+            passed = false;
+        }
+        ContractionTools c2(loaded);
+        c2.Contract(CostContractSimple, 1);
+        if (std::abs(c2.GetFinalVal().real() + .784044) > .000001) {
+            out << "Failed snapshot test after loading into a network" << std::endl;
+            passed = false;
+        }
+        loaded->Reset();
+        if (loaded->GetUncontractedNodes().size() != numUncontracted || loaded->IsDone()) {
+            out << "Failed snapshot reset test" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    removeFile("Samples/measureTest.txt");
+    removeFile("Samples/temp.qtsnap");
+    return passed;
+}
+
+//this function tests cloning a network before and part way through a contraction. Each clone must contract to the same
+//value as the original without disturbing it, and must share the gate tensors with the original until they are written to
+//returns true on success or false on failure
+//input ofstream is for printing errors/results
+bool cloneTest(std::ofstream& out)
+{
+    out<<"Running Clone Test"<<std::endl<<std::endl;
+    std::ofstream generateMeasurement("Samples/measureTest.txt");
+    generateMeasurement<<"Y X X Y";
+    generateMeasurement.close();
+    bool passed{true};
+    try {
+        std::shared_ptr<Network> original = std::make_shared<Network>("Samples/test_JW.qasm", "Samples/measureTest.txt");
+        int numUncontracted = original->GetUncontractedNodes().size();
+        std::shared_ptr<Network> clone = original->Clone();
+        if (clone->GetAllNodes()[5]->GetTensorData() != original->GetAllNodes()[5]->GetTensorData()) {
+            out << "Failed clone test - gate tensors were copied" << std::endl;
+            passed = false;
+        }
+        for (int i(0); i < 3; ++i) {
+            ContractionTools c(original->Clone());
+            c.Contract(Stochastic);
+            if (std::abs(c.GetFinalVal().real() + .784044) > .000001 || std::abs(c.GetFinalVal().imag()) > .00001) {
+                out << "Failed clone contraction, trial: " << i + 1 << std::endl;
+                passed = false;
+            }
+        }
+        if (original->GetUncontractedNodes().size() != numUncontracted || original->IsDone() ||
+            original->GetAllNodes()[5]->GetNumTensorVals() == 0) {
+            out << "Failed clone test - contracting a clone modified the original" << std::endl;
+            passed = false;
+        }
+
+        //clone part way through a contraction
+        original->ContractNodes(original->GetAllNodes()[0], original->GetAllNodes()[4], 100);
+        std::shared_ptr<Network> partial = original->Clone();
+        ContractionTools c(partial);
+        c.Contract(Stochastic);
+        ContractionTools c2(original);
+        c2.Contract(Stochastic);
+        if (std::abs(c.GetFinalVal().real() + .784044) > .000001 || std::abs(c2.GetFinalVal().real() + .784044) > .000001) {
+            out << "Failed clone test on a partially contracted network" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    removeFile("Samples/measureTest.txt");
+    return passed;
+}
+
+//this function tests circuits with parameterized angles. A parameterized circuit bound to a set of values must contract
+//to the same value as the circuit written out with those angles, for several rebindings of one parsed network
+//returns true on success or false on failure
+//input ofstream is for printing errors/results
+bool parameterTest(std::ofstream& out)
+{
+    out<<"Running Parameter Test"<<std::endl<<std::endl;
+    std::ofstream generateMeasurement("Samples/measureTest.txt");
+    generateMeasurement<<"X Z Y";
+    generateMeasurement.close();
+    //writes the test circuit, either with parameter slots or with the angles filled in
+    auto writeCircuit = [](const std::string& path, const std::vector<std::string>& angles) {
+        std::ofstream circuit(path);
+        circuit<<"3\nH 0\nH 1\nRx "<<angles[0]<<" 0\nRy "<<angles[1]<<" 1\nCNOT 0 2\nRz "<<angles[2]<<" 2\n";
+        circuit<<"CPHASE "<<angles[3]<<" 1 2\nPHASE "<<angles[4]<<" 0\nCNOT 2 1\nRx "<<angles[5]<<" 2\n";
+        circuit.close();
+    };
+    writeCircuit("Samples/tempParameterized.qasm", {"2*$0", "$1", "-$0", "0.5*$2", "$1", "-1*$2"});
+    bool passed{true};
+    try {
+        std::shared_ptr<Network> parameterized = std::make_shared<Network>("Samples/tempParameterized.qasm", "Samples/measureTest.txt");
+        if (parameterized->GetNumParameters() != 3) {
+            out << "Failed parameter count test" << std::endl;
+            passed = false;
+        }
+        std::vector<std::vector<double>> bindings{{0.3, 1.1, -0.7}, {2.5, 0.2, 1.9}, {-1.3, 0.8, 0.4}};
+        std::vector<std::complex<double>> expected;
+        for (auto &binding: bindings) {
+            std::vector<std::string> angles;
+            std::vector<double> values{2*binding[0], binding[1], -binding[0], 0.5*binding[2], binding[1], -binding[2]};
+            for (auto &value: values) {
+                std::ostringstream angle;
+                angle<<std::setprecision(17)<<value;
+                angles.push_back(angle.str());
+            }
+            writeCircuit("Samples/tempLiteral.qasm", angles);
+            ContractionTools literal("Samples/tempLiteral.qasm", "Samples/measureTest.txt");
+            literal.Contract(Stochastic);
+            expected.push_back(literal.GetFinalVal());
+        }
+
+        for (int i(0); i < bindings.size(); ++i) {
+            parameterized->BindParameters(bindings[i]);
+            ContractionTools c(parameterized->Clone());
+            c.Contract(Stochastic);
+            if (std::abs(c.GetFinalVal() - expected[i]) > .000001) {
+                out << "Failed parameter rebinding test, binding: " << i + 1 << std::endl;
+                passed = false;
+            }
+        }
+
+        //the binding must survive a reset, and contracting the network itself must give the same value
+        parameterized->Reset();
+        ContractionTools c(parameterized);
+        c.Contract(Stochastic);
+        if (std::abs(c.GetFinalVal() - expected.back()) > .000001) {
+            out << "Failed parameter test after reset" << std::endl;
+            passed = false;
+        }
+
+        bool threw{false};
+        try {
+            parameterized->BindParameters(bindings[0]);
+        }
+        catch (InvalidFunctionInput &e) {
+            threw = true;
+        }
+        if (!threw) {
+            out << "Failed parameter test - rebinding a contracted network did not throw" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    removeFile("Samples/measureTest.txt");
+    removeFile("Samples/tempParameterized.qasm");
+    removeFile("Samples/tempLiteral.qasm");
+    return passed;
+}
+
+//this function tests building a network in memory from a vector of gates and measurements. The network must contract to
+//the same value as the same circuit parsed from files, with every contraction method, and after a reset
+//returns true on success or false on failure
+//input ofstream is for printing errors/results
+bool builderTest(std::ofstream& out)
+{
+    out<<"Running Builder Test"<<std::endl<<std::endl;
+    std::ofstream generateMeasurement("Samples/measureTest.txt");
+    generateMeasurement<<"X Z Y";
+    generateMeasurement.close();
+    std::ofstream circuit("Samples/tempBuilder.qasm");
+    circuit<<"3\nH 0\nH 1\nRx 0.7 0\nCNOT 0 2\nRz -1.3 2\nCPHASE 0.4 1 2\nY 1\nH 2\nCZ 0 1\nRy 2.1 1\nSWAP 1 2\n";
+    circuit.close();
+    bool passed{true};
+    try {
+        ContractionTools fromFile("Samples/tempBuilder.qasm", "Samples/measureTest.txt");
+        fromFile.Contract(Stochastic);
+        std::complex<double> expected(fromFile.GetFinalVal());
+
+        double invSqrtTwo(1.0 / std::sqrt(2.0));
+        std::vector<Gate> gates{Gate("H", {0}), Gate("myH", {1}, {invSqrtTwo, invSqrtTwo, invSqrtTwo, -invSqrtTwo}),
+                                Gate("Rx", {0}, 0.7), Gate("CNOT", {0, 2}), Gate("Rz", {2}, -1.3),
+                                Gate("CPHASE", {1, 2}, 0.4), Gate("Y", {1}), Gate("H", {2}), Gate("CZ", {0, 1}),
+                                Gate("Ry", {1}), Gate("SWAP", {1, 2})};
+        gates[9].parameterSlot = 0;
+        std::shared_ptr<Network> built = std::make_shared<Network>(3, gates, std::vector<char>{'X', 'Z', 'Y'});
+        built->BindParameters({2.1});
+        std::vector<ContractionType> methods{Stochastic, FromEdges, CostContractSimple};
+        for (auto method: methods) {
+            ContractionTools c(built->Clone());
+            c.Contract(method);
+            if (std::abs(c.GetFinalVal() - expected) > .000001) {
+                out << "Failed builder test with contraction method: " << method << std::endl;
+                passed = false;
+            }
+        }
+        ContractionTools c(built);
+        c.Contract(Stochastic);
+        built->Reset();
+        c.Reset(built);
+        c.Contract(CostContractSimple);
+        if (std::abs(c.GetFinalVal() - expected) > .000001) {
+            out << "Failed builder test after reset" << std::endl;
+            passed = false;
+        }
+
+        bool threw{false};
+        try {
+            Network invalid(3, {Gate("CNOT", {0, 3})});
+        }
+        catch (InvalidFileFormat &e) {
+            threw = true;
+        }
+        if (!threw) {
+            out << "Failed builder test - a gate on a missing qubit did not throw" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    removeFile("Samples/measureTest.txt");
+    removeFile("Samples/tempBuilder.qasm");
+    return passed;
+}
+
+//this function tests that gate tensors are shared between nodes of the same gate, are only written to after being copied,
+//and follow the angle of a rebound gate
+//returns true on success or false on failure
+//input ofstream is for printing errors/results
+bool sharedTensorTest(std::ofstream& out)
+{
+    out<<"Running Shared Tensor Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        std::vector<Gate> gates{Gate("H", {0}), Gate("H", {1}), Gate("Rz", {0}, 0.25), Gate("Rz", {1}, 0.25),
+                                Gate("Rz", {1}, 0.5), Gate("CNOT", {0, 1})};
+        Network network(2, gates, {'Z', 'Z'});
+        const std::vector<std::shared_ptr<Node>> &nodes = network.GetAllNodes();
+        if (nodes[2]->GetTensorData() != nodes[3]->GetTensorData() ||
+            nodes[4]->GetTensorData() != nodes[5]->GetTensorData() ||
+            nodes[6]->GetTensorData() == nodes[4]->GetTensorData()) {
+            out << "Failed shared tensor test - gate tensors were not shared by gate and angle" << std::endl;
+            passed = false;
+        }
+
+        //writing to one node must not change the other nodes of the gate
+        std::complex<double> original(nodes[3]->Access(0));
+        nodes[2]->Index(0) = 5.0;
+        if (nodes[3]->Access(0) != original || Network(2, gates).GetAllNodes()[2]->Access(0) != original) {
+            out << "Failed shared tensor test - writing to a node changed a shared tensor" << std::endl;
+            passed = false;
+        }
+
+        nodes[6]->SetAngle(0.25);
+        if (nodes[6]->GetTensorData() != nodes[5]->GetTensorData()) {
+            out << "Failed shared tensor test - a rebound gate did not take the tensor of its new angle" << std::endl;
+            passed = false;
+        }
+
+        //threads reading a node whose values haven't been looked up yet must all get the same values
+        Network fresh(2, gates, {'Z', 'Z'});
+        const std::shared_ptr<Node> &freshNode = fresh.GetAllNodes()[6];
+        std::vector<const std::complex<double> *> seen(4);
+        std::vector<std::thread> readers;
+        for (int t(0); t < seen.size(); ++t) {
+            readers.push_back(std::thread([&seen, &freshNode, t]() { seen[t] = freshNode->GetTensorData(); }));
+        }
+        for (auto &reader: readers) {
+            reader.join();
+        }
+        if (std::count(seen.begin(), seen.end(), seen[0]) != seen.size() || seen[0] != freshNode->GetTensorData()) {
+            out << "Failed shared tensor test - concurrent reads of a node saw different values" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+//this function tests evaluating several observables on one circuit in a batch. Each value must match contracting the
+//circuit separately with that observable's measurement file
+//returns true on success or false on failure
+//input ofstream is for printing errors/results
+bool observablesTest(std::ofstream& out)
+{
+    out<<"Running Observables Test"<<std::endl<<std::endl;
+    std::vector<std::vector<char>> observables{{'Y', 'X', 'X', 'Y'}, {'Z', 'Z', 'T', 'T'}, {'X', 'Y', 'Y', 'X'},
+                                               {'T', 'Z'}, {'1', '0', 'Z', 'X'}};
+    bool passed{true};
+    try {
+        std::vector<std::complex<double>> expected;
+        for (auto &observable: observables) {
+            std::ofstream generateMeasurement("Samples/measureTest.txt");
+            for (char measurement: observable) {
+                generateMeasurement << measurement << " ";
+            }
+            generateMeasurement.close();
+            ContractionTools c("Samples/test_JW.qasm", "Samples/measureTest.txt");
+            c.Contract(Stochastic);
+            expected.push_back(c.GetFinalVal());
+        }
+
+        std::shared_ptr<Network> network = std::make_shared<Network>("Samples/test_JW.qasm", "");
+        ContractionTools batch(network);
+        std::vector<ContractionType> methods{Stochastic, CostContractSimple};
+        for (auto method: methods) {
+            std::vector<std::complex<double>> results(batch.ContractObservables(observables, method));
+            for (int i(0); i < observables.size(); ++i) {
+                if (results.size() != observables.size() || std::abs(results[i] - expected[i]) > .000001) {
+                    out << "Failed observables test, method: " << method << ", observable: " << i + 1 << std::endl;
+                    passed = false;
+                    break;
+                }
+            }
+        }
+        if (network->IsDone() || network->GetUncontractedNodes().size() != network->GetAllNodes().size()) {
+            out << "Failed observables test - the batch modified the network" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    removeFile("Samples/measureTest.txt");
+    return passed;
+}
+
+bool reducedDensityMatrixTest(std::ofstream& out)
+{
+    out<<"Running Reduced Density Matrix Test"<<std::endl<<std::endl;
+    //the measurement operators in the superoperator basis, as in the measurement nodes
+    std::unordered_map<char, std::vector<std::complex<double>>> operators{
+            {'T', {1, 0, 0, 1}}, {'X', {0, 1, 1, 0}}, {'Y', {0, std::complex<double>(0, 1), std::complex<double>(0, -1), 0}},
+            {'Z', {1, 0, 0, -1}}};
+    std::string paulis("TXYZ");
+    bool passed{true};
+    try {
+        //every observable on qubits 1 and 2, evaluated directly
+        std::vector<std::vector<char>> observables;
+        for (char one: paulis) {
+            for (char two: paulis) {
+                observables.push_back({'T', one, two, 'T'});
+            }
+        }
+        std::shared_ptr<Network> network = std::make_shared<Network>("Samples/test_JW.qasm", "");
+        ContractionTools c(network);
+        std::vector<std::complex<double>> expected(c.ContractObservables(observables, Stochastic));
+
+        std::vector<ContractionType> methods{Stochastic, CostContractSimple};
+        for (auto method: methods) {
+            std::vector<std::complex<double>> rdm(c.ReducedDensityMatrix({2, 1}, method));
+            if (rdm.size() != 16) {
+                out << "Failed reduced density matrix test, method: " << method << " - wrong size" << std::endl;
+                passed = false;
+                continue;
+            }
+            for (int i(0); i < observables.size(); ++i) {
+                std::complex<double> value(0);
+                for (int j(0); j < 16; ++j) {
+                    value += operators[observables[i][1]][j % 4] * operators[observables[i][2]][j / 4] * rdm[j];
+                }
+                if (std::abs(value - expected[i]) > .000001) {
+                    out << "Failed reduced density matrix test, method: " << method << ", observable: " << i + 1
+                        << std::endl;
+                    passed = false;
+                    break;
+                }
+            }
+        }
+        if (network->IsDone() || network->GetUncontractedNodes().size() != network->GetAllNodes().size()) {
+            out << "Failed reduced density matrix test - the network was modified" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool samplerTest(std::ofstream& out)
+{
+    out<<"Running Sampler Test"<<std::endl<<std::endl;
+    //a bell pair on qubits 0 and 1, with qubits 2 and 3 flipped (the CZ only changes phases)
+    std::vector<Gate> circuit{Gate("H", {0}), Gate("CNOT", {0, 1}), Gate("X", {2}), Gate("CNOT", {2, 3}), Gate("CZ", {1, 2})};
+    bool passed{true};
+    try {
+        ContractionTools c(std::make_shared<Network>(4, circuit));
+        std::vector<ContractionType> methods{Stochastic, CostContractSimple};
+        for (auto method: methods) {
+            std::vector<std::vector<bool>> samples(c.SampleBitstrings(400, method));
+            int ones(0);
+            for (auto &sample: samples) {
+                if (sample.size() != 4 || sample[0] != sample[1] || !sample[2] || !sample[3]) {
+                    out << "Failed sampler test, method: " << method << " - impossible bitstring drawn" << std::endl;
+                    passed = false;
+                    break;
+                }
+                ones += sample[0];
+            }
+            if (samples.size() != 400 || ones < 140 || ones > 260) {
+                out << "Failed sampler test, method: " << method << ", bell pair drawn as 11 " << ones << "/400 times"
+                    << std::endl;
+                passed = false;
+            }
+        }
+
+        //the greedy string takes the more likely value of each qubit in turn
+        std::vector<Gate> biased{Gate("Ry", {0}, 0.6), Gate("Ry", {1}, 2.5), Gate("X", {2}), Gate("CNOT", {1, 3})};
+        ContractionTools greedy(std::make_shared<Network>(4, biased));
+        if (greedy.MostLikelyBitstring(Stochastic) != std::vector<bool>{false, true, true, true}) {
+            out << "Failed sampler test - wrong most likely bitstring" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool pauliSumTest(std::ofstream& out)
+{
+    out<<"Running Pauli Sum Test"<<std::endl<<std::endl;
+    //short terms that share bases, a term too long to group, and the identity
+    std::vector<PauliTerm> terms{{0.5, {'Z', 'Z'}}, {-1.2, {'I', 'X', 'X'}}, {std::complex<double>(0, 0.3), {'Y', 'I', 'I', 'I', 'I', 'Z'}},
+                                 {0.25, {'I', 'I', 'Z', 'I', 'Z'}}, {0.7, {'X', 'Y', 'Z', 'Z', 'Y', 'X'}}, {2.0, {}},
+                                 {-0.4, {'I', 'X', 'I', 'Y'}}, {0.9, {'I', 'Z'}}};
+    bool passed{true};
+    try {
+        std::shared_ptr<Network> network = std::make_shared<Network>("Samples/rand-nq6-cn2-d10_rxyz.qasm", "");
+        ContractionTools c(network);
+        std::vector<std::vector<char>> observables;
+        for (auto &term: terms) {
+            std::vector<char> observable(term.paulis);
+            std::replace(observable.begin(), observable.end(), 'I', 'T');
+            observables.push_back(observable);
+        }
+        std::vector<std::complex<double>> values(c.ContractObservables(observables, Stochastic));
+        std::complex<double> expected(0.0);
+        for (int i(0); i < terms.size(); ++i) {
+            expected += terms[i].coefficient * values[i];
+        }
+
+        std::complex<double> result(c.ExpectationValue(terms, Stochastic));
+        if (std::abs(result - expected) > .000001) {
+            out << "Failed pauli sum test, expected: " << expected << " got: " << result << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool gradientTest(std::ofstream& out)
+{
+    out<<"Running Gradient Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        std::shared_ptr<Network> parameterized = loadParameterizedCircuit();
+        std::vector<double> binding{0.3, 1.1, -0.7};
+        //the value of the circuit with the given angles
+        auto evaluate = [&parameterized](const std::vector<double>& angles) {
+            parameterized->BindParameters(angles);
+            ContractionTools c(parameterized->Clone());
+            c.Contract(Stochastic);
+            return c.GetFinalVal();
+        };
+        std::complex<double> value(evaluate(binding));
+        ContractionTools c(parameterized);
+        std::vector<std::complex<double>> gradient(c.Gradient(Stochastic));
+        if (gradient.size() != 3 || std::abs(c.GetFinalVal() - value) > .000001) {
+            out << "Failed gradient test, wrong size or value" << std::endl;
+            passed = false;
+        }
+        //compare with central differences
+        double h(1e-5);
+        for (int i(0); passed && i < binding.size(); ++i) {
+            std::vector<double> up(binding), down(binding);
+            up[i] += h;
+            down[i] -= h;
+            std::complex<double> expected((evaluate(up) - evaluate(down)) / (2 * h));
+            if (std::abs(gradient[i] - expected) > .00001) {
+                out << "Failed gradient test, parameter: " << i << " expected: " << expected << " got: " << gradient[i] << std::endl;
+                passed = false;
+            }
+        }
+
+        //a snapshot keeps the bound parameters but not the angles of its nodes
+        parameterized->BindParameters(binding);
+        parameterized->SaveSnapshot("Samples/tempParameterized.qtsnap");
+        std::vector<std::complex<double>> loaded(
+                ContractionTools(std::make_shared<Network>("Samples/tempParameterized.qtsnap", "")).Gradient(Stochastic));
+        for (int i(0); passed && i < binding.size(); ++i) {
+            if (loaded.size() != gradient.size() || std::abs(loaded[i] - gradient[i]) > .000001) {
+                out << "Failed gradient test from a snapshot, parameter: " << i << std::endl;
+                passed = false;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    removeFile("Samples/tempParameterized.qtsnap");
+    return passed;
+}
+
+bool batchTest(std::ofstream& out)
+{
+    out<<"Running Batch Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        std::shared_ptr<Network> parameterized = loadParameterizedCircuit();
+        std::vector<std::vector<double>> bindings{{0.3, 1.1, -0.7}, {2.5, 0.2, 1.9}, {-1.3, 0.8, 0.4}, {0.0, 0.0, 0.0}};
+        std::vector<std::complex<double>> values(ContractionTools(parameterized).ContractBatch(bindings, Stochastic));
+        if (values.size() != bindings.size()) {
+            out << "Failed batch test, wrong number of values" << std::endl;
+            passed = false;
+        }
+        for (int i(0); passed && i < bindings.size(); ++i) {
+            parameterized->BindParameters(bindings[i]);
+            ContractionTools c(parameterized->Clone());
+            c.Contract(Stochastic);
+            if (std::abs(values[i] - c.GetFinalVal()) > .000001) {
+                out << "Failed batch test, binding: " << i + 1 << " expected: " << c.GetFinalVal() << " got: " << values[i] << std::endl;
+                passed = false;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool incrementalTest(std::ofstream& out)
+{
+    out<<"Running Incremental Contraction Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        std::shared_ptr<Network> parameterized = loadParameterizedCircuit();
+        ContractionTools incremental(parameterized->Clone());
+        //one parameter changes at a time, then all of them, then none
+        std::vector<std::vector<double>> bindings{{0.3, 1.1, -0.7}, {0.3, 1.1, 1.9}, {-1.3, 1.1, 1.9},
+                                                  {-1.3, 0.8, 1.9}, {2.5, 0.2, 0.4}, {2.5, 0.2, 0.4}};
+        for (int i(0); passed && i < bindings.size(); ++i) {
+            std::complex<double> value(incremental.ContractIncremental(bindings[i], Stochastic));
+            parameterized->BindParameters(bindings[i]);
+            ContractionTools c(parameterized->Clone());
+            c.Contract(Stochastic);
+            if (std::abs(value - c.GetFinalVal()) > .000001 || incremental.GetFinalVal() != value) {
+                out << "Failed incremental test, binding: " << i + 1 << " expected: " << c.GetFinalVal() << " got: " << value << std::endl;
+                passed = false;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool memoTest(std::ofstream& out)
+{
+    out<<"Running Subtree Memo Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        std::shared_ptr<Network> network = std::make_shared<Network>("Samples/rand-nq6-cn2-d10_rxyz.qasm", "");
+        ContractionTools c(network->Clone());
+        c.Contract(Stochastic);
+        std::complex<double> expected(c.GetFinalVal());
+
+        ContractionTools memoized(network);
+        std::vector<std::pair<int, int>> sequence(memoized.PlanContractionSequence(Stochastic));
+        std::complex<double> first(memoized.ContractMemoized(sequence));
+        long long firstHits(memoized.GetNumMemoHits());
+        //a second contraction of the same network finds every step in the table
+        std::complex<double> second(memoized.ContractMemoized(sequence));
+        if (std::abs(first - expected) > .000001 || std::abs(second - expected) > .000001) {
+            out << "Failed memo test, expected: " << expected << " got: " << first << " and " << second << std::endl;
+            passed = false;
+        }
+        if (memoized.GetNumMemoHits() - firstHits != sequence.size()) {
+            out << "Failed memo test, hits on the second contraction: " << memoized.GetNumMemoHits() - firstHits << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool rzzTest(std::ofstream& out)
+{
+    out<<"Running RZZ Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        //each RZZ(angle) is the same as CNOT, Rz(angle) on the target, CNOT
+        auto buildCircuit = [](bool native) {
+            std::vector<Gate> circuit{Gate("H", {0}), Gate("H", {1}), Gate("Ry", {2}, 0.8)};
+            std::vector<std::pair<int, int>> couplings{{0, 1}, {1, 2}, {2, 0}};
+            std::vector<double> angles{0.9, -1.7, 2.3};
+            for (int i(0); i < couplings.size(); ++i) {
+                if (native) {
+                    circuit.push_back(Gate("RZZ", {couplings[i].first, couplings[i].second}, angles[i]));
+                } else {
+                    circuit.push_back(Gate("CNOT", {couplings[i].first, couplings[i].second}));
+                    circuit.push_back(Gate("Rz", {couplings[i].second}, angles[i]));
+                    circuit.push_back(Gate("CNOT", {couplings[i].first, couplings[i].second}));
+                }
+                circuit.push_back(Gate("Rx", {couplings[i].first}, 0.6 * (i + 1)));
+            }
+            return circuit;
+        };
+        std::vector<std::vector<char>> measurements{{'X', 'Y', 'Z'}, {'Z', 'Z', 'T'}, {'Y', 'X', 'X'}};
+        for (auto &measurement: measurements) {
+            ContractionTools native(std::make_shared<Network>(3, buildCircuit(true), measurement));
+            native.Contract(Stochastic);
+            ContractionTools decomposed(std::make_shared<Network>(3, buildCircuit(false), measurement));
+            decomposed.Contract(Stochastic);
+            if (std::abs(native.GetFinalVal() - decomposed.GetFinalVal()) > .000001) {
+                out << "Failed RZZ test, expected: " << decomposed.GetFinalVal() << " got: " << native.GetFinalVal() << std::endl;
+                passed = false;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool hyperedgeTest(std::ofstream& out)
+{
+    out<<"Running Hyperedge Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        //chains of diagonal gates between the mixing layers share one index per qubit
+        std::vector<Gate> circuit;
+        for (int qubit(0); qubit < 4; ++qubit) {
+            circuit.push_back(Gate("H", {qubit}));
+        }
+        for (int layer(0); layer < 2; ++layer) {
+            for (int qubit(0); qubit < 4; ++qubit) {
+                circuit.push_back(Gate("RZZ", {qubit, (qubit + 1) % 4}, 0.7 + layer));
+            }
+            circuit.push_back(Gate("CZ", {0, 2}));
+            circuit.push_back(Gate("CRk", {1, 3}));
+            circuit.push_back(Gate("CPHASE", {3, 0}, -0.4));
+            circuit.push_back(Gate("Rz", {1}, 1.1));
+            circuit.push_back(Gate("PHASE", {2}, 0.3));
+            circuit.push_back(Gate("Z", {3}));
+            for (int qubit(0); qubit < 4; ++qubit) {
+                circuit.push_back(Gate("Rx", {qubit}, 0.5 * (qubit + layer + 1)));
+            }
+        }
+        std::vector<std::vector<char>> measurements{{'Z', 'Z', 'T', 'T'}, {'X', 'Y', 'Z', 'X'}, {'T', 'T', 'T', 'T'}};
+        for (auto &measurement: measurements) {
+            ContractionTools expected(std::make_shared<Network>(4, circuit, measurement));
+            expected.Contract(Stochastic);
+            ContractionTools hyperedges(std::make_shared<Network>(4, circuit, measurement));
+            std::complex<double> result(hyperedges.ContractWithHyperedges());
+            if (std::abs(result - expected.GetFinalVal()) > .000001) {
+                out << "Failed hyperedge test, expected: " << expected.GetFinalVal() << " got: " << result << std::endl;
+                passed = false;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool permutationTest(std::ofstream& out)
+{
+    out<<"Running Permutation Gate Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        //SWAPs are rewired and X and CNOT are gathered - the reference spells them with a dense SWAP matrix and H, Z, CZ
+        std::vector<std::complex<double>> swapMatrix{1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1};
+        auto buildCircuit = [&swapMatrix](bool permutations) {
+            std::vector<Gate> circuit{Gate("H", {0}), Gate("Ry", {1}, 0.4), Gate("Rx", {2}, 1.3)};
+            auto addSwap = [&](int one, int two) {
+                circuit.push_back(permutations ? Gate("SWAP", {one, two}) : Gate("mySwap", {one, two}, swapMatrix));
+            };
+            auto addCNOT = [&](int control, int target) {
+                if (permutations) {
+                    circuit.push_back(Gate("CNOT", {control, target}));
+                } else {
+                    circuit.push_back(Gate("H", {target}));
+                    circuit.push_back(Gate("CZ", {control, target}));
+                    circuit.push_back(Gate("H", {target}));
+                }
+            };
+            auto addX = [&](int qubit) {
+                if (permutations) {
+                    circuit.push_back(Gate("X", {qubit}));
+                } else {
+                    circuit.push_back(Gate("H", {qubit}));
+                    circuit.push_back(Gate("Z", {qubit}));
+                    circuit.push_back(Gate("H", {qubit}));
+                }
+            };
+            addCNOT(0, 1);
+            addSwap(0, 2);
+            circuit.push_back(Gate("Rz", {0}, 0.9));
+            addX(1);
+            addSwap(1, 2);
+            addCNOT(2, 0);
+            circuit.push_back(Gate("Ry", {2}, -0.7));
+            addSwap(0, 1);
+            addX(0);
+            addCNOT(1, 2);
+            return circuit;
+        };
+        std::vector<std::vector<char>> measurements{{'Z', 'T', 'X'}, {'Y', 'Z', 'Z'}, {'T', 'X', '1'}};
+        for (auto &measurement: measurements) {
+            std::vector<ContractionType> methods{Stochastic, FromEdges};
+            for (auto method: methods) {
+                ContractionTools permuted(std::make_shared<Network>(3, buildCircuit(true), measurement));
+                permuted.Contract(method);
+                ContractionTools reference(std::make_shared<Network>(3, buildCircuit(false), measurement));
+                reference.Contract(method);
+                if (std::abs(permuted.GetFinalVal() - reference.GetFinalVal()) > .000001) {
+                    out << "Failed permutation test, method: " << method << ", expected: " << reference.GetFinalVal()
+                        << " got: " << permuted.GetFinalVal() << std::endl;
+                    passed = false;
+                }
+            }
+        }
+
+        //the rewired qubits keep their numbers in a reduced density matrix
+        ContractionTools permuted(std::make_shared<Network>(3, buildCircuit(true)));
+        ContractionTools reference(std::make_shared<Network>(3, buildCircuit(false)));
+        std::vector<std::complex<double>> rdm(permuted.ReducedDensityMatrix({2, 0}, Stochastic));
+        std::vector<std::complex<double>> expected(reference.ReducedDensityMatrix({2, 0}, Stochastic));
+        for (int i(0); i < expected.size(); ++i) {
+            if (rdm.size() != expected.size() || std::abs(rdm[i] - expected[i]) > .000001) {
+                out << "Failed permutation test - reduced density matrix entry " << i << std::endl;
+                passed = false;
+                break;
+            }
+        }
+        //and a snapshot keeps which line carries each qubit
+        std::make_shared<Network>(3, buildCircuit(true))->SaveSnapshot("Samples/tempPermutation.qtsnap");
+        ContractionTools fromSnapshot(std::make_shared<Network>("Samples/tempPermutation.qtsnap", ""));
+        rdm = fromSnapshot.ReducedDensityMatrix({2, 0}, Stochastic);
+        for (int i(0); i < expected.size(); ++i) {
+            if (rdm.size() != expected.size() || std::abs(rdm[i] - expected[i]) > .000001) {
+                out << "Failed permutation test - reduced density matrix entry " << i << " from a snapshot" << std::endl;
+                passed = false;
+                break;
+            }
+        }
+        std::shared_ptr<Network> rewired = std::make_shared<Network>(3, std::vector<Gate>{Gate("SWAP", {0, 1})});
+        if (rewired->GetAllNodes().size() != 6) {
+            out << "Failed permutation test - a SWAP added a node" << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    removeFile("Samples/tempPermutation.qtsnap");
+    return passed;
+}
+
+bool boundaryTest(std::ofstream& out)
+{
+    out<<"Running Boundary Node Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        //qubit 3 has no gates, so its initial state and measurement stay
+        std::vector<Gate> circuit{Gate("H", {0}), Gate("Ry", {1}, 0.6), Gate("CNOT", {0, 2}), Gate("Rx", {2}, -1.1),
+                                  Gate("CZ", {1, 2}), Gate("H", {1}), Gate("Rz", {0}, 0.3), Gate("CNOT", {2, 0})};
+        std::vector<std::vector<char>> measurements{{'Z', 'X', 'Y', 'Z'}, {'1', 'T', '0', 'T'}, {'X', 'Z', 'T', '0'}};
+        for (auto &measurement: measurements) {
+            std::shared_ptr<Network> network = std::make_shared<Network>(4, circuit, measurement);
+            ContractionTools plain(network->Clone());
+            plain.Contract(Stochastic);
+
+            std::vector<ContractionType> methods{Stochastic, FromEdges};
+            for (auto method: methods) {
+                std::shared_ptr<Network> absorbed = network->Clone();
+                absorbed->AbsorbBoundaryNodes();
+                if (absorbed->GetUncontractedNodes().size() != network->GetUncontractedNodes().size() - 6) {
+                    out << "Failed boundary node test - " << absorbed->GetUncontractedNodes().size()
+                        << " nodes left after absorbing" << std::endl;
+                    passed = false;
+                }
+                ContractionTools c(absorbed);
+                c.Contract(method);
+                if (std::abs(c.GetFinalVal() - plain.GetFinalVal()) > .000001) {
+                    out << "Failed boundary node test, method: " << method << ", expected: " << plain.GetFinalVal()
+                        << " got: " << c.GetFinalVal() << std::endl;
+                    passed = false;
+                }
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool sparseTest(std::ofstream& out)
+{
+    out<<"Running Sparse Contraction Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        //iSWAP and Y are sparse without being permutations, and the projections leave zeros in the intermediates - the
+        //hyperedge contraction (see ContractionTools::ContractWithHyperedges) uses its own dense kernel
+        std::complex<double> i(0, 1);
+        std::vector<std::complex<double>> iSwap{1, 0, 0, 0, 0, 0, i, 0, 0, i, 0, 0, 0, 0, 0, 1};
+        std::vector<Gate> circuit{Gate("H", {0}), Gate("Ry", {1}, 0.8), Gate("iSWAP", {0, 1}, iSwap),
+                                  Gate("Y", {2}), Gate("Rx", {2}, 0.5), Gate("iSWAP", {1, 2}, iSwap),
+                                  Gate("H", {1}), Gate("Y", {0}), Gate("iSWAP", {2, 0}, iSwap), Gate("Rz", {1}, -0.6)};
+        std::vector<std::vector<char>> measurements{{'0', 'Z', 'X'}, {'1', '1', 'Y'}, {'Z', '0', '1'}};
+        for (auto &measurement: measurements) {
+            ContractionTools sparse(std::make_shared<Network>(3, circuit, measurement));
+            sparse.Contract(Stochastic);
+            ContractionTools reference(std::make_shared<Network>(3, circuit, measurement));
+            std::complex<double> expected(reference.ContractWithHyperedges());
+            if (std::abs(sparse.GetFinalVal() - expected) > .000001) {
+                out << "Failed sparse test, expected: " << expected << " got: " << sparse.GetFinalVal() << std::endl;
+                passed = false;
+            }
+        }
+
+        //a wider circuit, so that sparse nodes make results large enough to be split between threads
+        std::vector<Gate> wide;
+        for (int layer(0); layer < 2; ++layer) {
+            for (int qubit(0); qubit < 10; ++qubit) {
+                wide.push_back(Gate("Ry", {qubit}, 0.4 + 0.3 * qubit - 0.5 * layer));
+                wide.push_back(Gate("iSWAP", {qubit, (qubit + 1) % 10}, iSwap));
+                wide.push_back(Gate("Y", {qubit}));
+            }
+        }
+        std::vector<char> wideMeasurement{'0', 'Z', '1', 'X', 'T', '0', 'Y', '1', 'Z', '0'};
+        ContractionTools wideSparse(std::make_shared<Network>(10, wide, wideMeasurement));
+        wideSparse.Contract(Stochastic);
+        ContractionTools wideReference(std::make_shared<Network>(10, wide, wideMeasurement));
+        std::complex<double> wideExpected(wideReference.ContractWithHyperedges());
+        if (std::abs(wideSparse.GetFinalVal() - wideExpected) > .000001) {
+            out << "Failed sparse test, expected: " << wideExpected << " got: " << wideSparse.GetFinalVal() << std::endl;
+            passed = false;
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool mixedPrecisionTest(std::ofstream& out)
+{
+    out<<"Running Mixed Precision Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        std::vector<Gate> circuit;
+        for (int layer(0); layer < 3; ++layer) {
+            for (int qubit(0); qubit < 4; ++qubit) {
+                circuit.push_back(Gate("Ry", {qubit}, 0.3 + 0.7 * qubit - 0.4 * layer));
+                circuit.push_back(Gate("CNOT", {qubit, (qubit + 1) % 4}));
+                circuit.push_back(Gate("Rz", {qubit}, 1.1 * layer - 0.2 * qubit));
+            }
+        }
+        std::vector<std::vector<char>> measurements{{'Z', 'X', 'T', 'Y'}, {'Z', 'Z', 'Z', 'Z'}, {'X', 'T', '0', 'T'}};
+        for (auto &measurement: measurements) {
+            ContractionTools c(std::make_shared<Network>(4, circuit, measurement));
+            std::vector<std::pair<int, int>> sequence(c.PlanContractionSequence(Stochastic));
+            std::complex<double> expected(c.ContractObservables({measurement}, sequence)[0]);
+            std::complex<double> single(c.ContractMixedPrecision(sequence));
+            //single precision storage keeps about seven significant digits
+            if (std::abs(single - expected) > .00001 || single != c.GetFinalVal()) {
+                out << "Failed mixed precision test, expected: " << expected << " got: " << single << std::endl;
+                passed = false;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+bool pauliBasisTest(std::ofstream& out)
+{
+    out<<"Running Pauli Basis Test"<<std::endl<<std::endl;
+    bool passed{true};
+    try {
+        double invSqrtTwo(1.0 / std::sqrt(2.0));
+        std::vector<Gate> circuit{Gate("H", {0}), Gate("myH", {1}, {invSqrtTwo, invSqrtTwo, invSqrtTwo, -invSqrtTwo}),
+                                  Gate("Rx", {2}, 0.7), Gate("CNOT", {0, 2}), Gate("Y", {1}), Gate("RZZ", {1, 2}, 1.3),
+                                  Gate("CPHASE", {0, 1}, -0.5), Gate("Ry", {0}, 2.2), Gate("PHASE", {2}, 0.9),
+                                  Gate("SWAP", {0, 1}), Gate("H", {2})};
+        std::vector<std::vector<char>> measurements{{'Z', 'X', 'Y'}, {'Y', 'Z', 'T'}, {'1', 'X', 'Z'}};
+        for (auto &measurement: measurements) {
+            ContractionTools c(std::make_shared<Network>(3, circuit, measurement));
+            std::vector<std::pair<int, int>> sequence(c.PlanContractionSequence(Stochastic));
+            std::complex<double> expected(c.ContractObservables({measurement}, sequence)[0]);
+            double value(c.ContractPauliBasis(sequence));
+            if (std::abs(value - expected) > .000001 || value != c.GetFinalVal()) {
+                out << "Failed pauli basis test, expected: " << expected << " got: " << value << std::endl;
+                passed = false;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        out<<"Failed Test with exception: "<<e.what()<<std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
 //this function runs all selected tests
 //to modify which tests are run, simply change the flag from true to false in the testsToRun map.
 //the function takes in a string, which is the testing log file path
@@ -2022,7 +3058,27 @@ void runTests(const std::string& fileToOutputTo)
                               {testUserDefinedSequence,true},
                               {largeCircuitTest, true},
                               {randomCircuitsTest,true},
-                              {unconnectedCircuitsTest,true}
+                              {unconnectedCircuitsTest,true},
+                              {snapshotTest,true},
+                              {cloneTest,true},
+                              {parameterTest,true},
+                              {builderTest,true},
+                              {sharedTensorTest,true},
+                              {observablesTest,true},
+                              {reducedDensityMatrixTest,true},
+                              {samplerTest,true},
+                              {pauliSumTest,true},
+                              {gradientTest,true},
+                              {batchTest,true},
+                              {incrementalTest,true},
+                              {memoTest,true},
+                              {rzzTest,true},
+                              {hyperedgeTest,true},
+                              {permutationTest,true},
+                              {boundaryTest,true},
+                              {sparseTest,true},
+                              {mixedPrecisionTest,true},
+                              {pauliBasisTest,true}
                       });
 
 